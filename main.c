@@ -14,6 +14,16 @@
 #define PIXEL_BUF_CTRL_BASE   0xFF203020
 #define CHAR_BUF_CTRL_BASE    0xFF203030
 #define AUDIO_BASE            0xFF203040
+#define PS2_BASE              0xFF200100
+#define KEY_EDGE_BASE         0xFF20005C
+#define JTAG_UART_BASE        0xFF201000
+
+/* ARM A9 MPCORE generic interrupt controller */
+#define MPCORE_GIC_CPUIF      0xFFFEC100
+#define MPCORE_GIC_DIST       0xFFFED000
+#define A9_ONCHIP_END         0xFFFFFFFF
+#define PS2_IRQ               79
+#define AUDIO_IRQ             78
 
 /* VGA colors */
 #define WHITE 0xFFFF
@@ -26,8 +36,11 @@
 #define GREY 0xC618
 #define PINK 0xFC18
 #define ORANGE 0xFC00
+#define WATER_BLUE 0x9E7F
 
 #define ABS(x) (((x) > 0) ? (x) : -(x))
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
 /* Screen size. */
 #define RESOLUTION_X 320
@@ -40,6 +53,29 @@
 #define ARM_LENGTH_X 20
 #define ARM_LENGTH_Y 10
 
+/* Screen layout of the game screen. Text positions are character buffer
+ * cells, 4x4 pixels each. */
+#define SNOWMAN_AREA_X 130
+#define SNOWMAN_AREA_WIDTH (RESOLUTION_X - SNOWMAN_AREA_X)
+#define TEXT_COL 5
+#define WORD_ROW 17
+#define GUESSES_ROW 25
+#define HINT_ROW 32
+#define MESSAGE_COL 2
+#define LETTER_WIDTH 10     // pixel text, see draw_word
+#define LETTER_HEIGHT 16
+
+/* Game rules */
+#define MAX_HEALTH 5
+#define AUTOPLAY_FRAMES 30      // frames between guesses in the auto-play demo (SW0)
+
+/* Pixel buffers: on-chip memory and two in SDRAM */
+#define NUM_PIXEL_BUFFERS 3
+#define PIXEL_BUFFER_BYTES 0x40000      // 240 rows of 1024 bytes, rounded up
+
+/* Damage tracking */
+#define MAX_DAMAGE_RECTS 8
+
 /* WORDS */
 #define EASY1 "apple"
 #define EASY2 "beach"
@@ -69,60 +105,971 @@
 #include <stdio.h>
 #include <stdint.h> 
 #include <string.h>
+#include <ctype.h>
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+/* Device access. On the board registers and pixel buffers are dereferenced
+ * directly; built with -DHOST_SIM the same addresses go to the simulator in
+ * sim/de1soc_sim.c so the game can run headless on a PC. */
+#ifdef HOST_SIM
+#include "sim/de1soc_sim.h"
+#define IO_READ(addr)           ((int)sim_io_read((uint32_t)(addr)))
+#define IO_WRITE(addr, value)   sim_io_write((uint32_t)(addr), (uint32_t)(value))
+#define MEM_ADDR(addr)          sim_mem((uint32_t)(addr))
+#else
+#define IO_READ(addr)           (*(volatile int *)(addr))
+#define IO_WRITE(addr, value)   (*(volatile int *)(addr) = (value))
+#define MEM_ADDR(addr)          ((char *)(addr))
+#endif
+
+/* Clock for animations, and for profiling with -DPROFILE_INTERVAL_TIMER. On
+ * the board the interval timer counts down at 100 MHz over its full 32-bit
+ * period; in the simulator it is the virtual clock, so animations take the
+ * same frames in every run. Only differences of two readings are
+ * meaningful. */
+#ifdef HOST_SIM
+#define CLOCK_TICKS_PER_MS 1000
+#else
+#define CLOCK_TICKS_PER_MS 100000
+#endif
+
+void clock_init(){
+#ifndef HOST_SIM
+    IO_WRITE(TIMER_BASE + 8, 0xFFFF);   // longest period, continuous
+    IO_WRITE(TIMER_BASE + 12, 0xFFFF);
+    IO_WRITE(TIMER_BASE + 4, 0x6);      // START | CONT
+#endif
+}
+
+uint32_t clock_ticks(){
+#ifdef HOST_SIM
+    return (uint32_t)(sim_time_ns() / 1000);
+#else
+    IO_WRITE(TIMER_BASE + 16, 0);       // snapshot the down counter
+    return ~(uint32_t)((IO_READ(TIMER_BASE + 20) << 16) | (IO_READ(TIMER_BASE + 16) & 0xFFFF));
+#endif
+}
+
+/* JTAG UART output. On the board, output for the host (the profile report,
+ * the capture stream) is queued in a ring and fed to the UART while present
+ * polls, never waiting for it: with no terminal attached the UART never
+ * drains, and whatever doesn't fit in the ring is dropped. Each write goes
+ * in whole or not at all, under a lock, since either core may write; only
+ * the presenting core drains. */
+#if !defined(HOST_SIM) && (defined(PROFILE) || defined(CAPTURE))
+#ifdef CAPTURE
+#define UART_RING_SIZE 0x40000      // power of two, room for a key frame
+#else
+#define UART_RING_SIZE 0x2000       // a profile report
+#endif
+uint8_t uart_ring[UART_RING_SIZE];
+volatile unsigned int uart_head, uart_tail;
+int uart_lock;
+
+int uart_write(const void *data, int size){
+    // FALSE if the ring has no room, and nothing was queued
+    const uint8_t *bytes = data;
+    int queued = FALSE;
+    while (__sync_lock_test_and_set(&uart_lock, 1))
+        ;
+    unsigned int head = uart_head;
+    if ((unsigned int)size <= UART_RING_SIZE - (head - uart_tail)){
+        for (int i = 0; i < size; i++)
+            uart_ring[(head + i) & (UART_RING_SIZE - 1)] = bytes[i];
+        __sync_synchronize();
+        uart_head = head + size;
+        queued = TRUE;
+    }
+    __sync_lock_release(&uart_lock);
+    return queued;
+}
+
+void uart_drain(){
+    // feed the UART what it has room for
+    unsigned int tail = uart_tail;
+    while (tail != uart_head){
+        unsigned int space = (unsigned int)IO_READ(JTAG_UART_BASE + 4) >> 16;     // WSPACE
+        if (space == 0)
+            break;
+        for (; space > 0 && tail != uart_head; space--)
+            IO_WRITE(JTAG_UART_BASE, uart_ring[tail++ & (UART_RING_SIZE - 1)]);
+    }
+    __sync_synchronize();
+    uart_tail = tail;
+}
+#else
+#define uart_drain()
+#endif
+
+/* Profiling. Built with -DPROFILE, PROBE_BEGIN/PROBE_END pairs time a stage
+ * of the frame and write one event into the trace ring. Any code, including
+ * interrupt handlers, may record, so slots are claimed with an atomic add and
+ * the oldest events are overwritten. Without PROFILE the probes are empty.
+ * Time comes from the A9 cycle counter (or the interval timer with
+ * -DPROFILE_INTERVAL_TIMER) on the board and from the monotonic clock in the
+ * simulator. profile_dump prints per-stage histograms and the slowest frames
+ * to the JTAG UART (see above), or on the host to HANGMAN_PROFILE (default
+ * stderr). */
+enum profile_stage {
+    STAGE_FRAME, STAGE_CLEAR, STAGE_SNOWMAN, STAGE_SPHERE, STAGE_TEXT,
+    STAGE_INPUT, STAGE_AUDIO, STAGE_VSYNC, STAGE_RASTER, STAGE_PARTICLES, STAGE_CAPTURE, NUM_STAGES
+};
+
+#ifdef PROFILE
+#define TRACE_SIZE 16384        // power of two
+#define PROFILE_WORST_FRAMES 5
+#define PROFILE_BUCKETS 16      // duration histogram, bucket i holds < 2^i us
+
+#if defined(HOST_SIM)
+#include <time.h>
+#define PROFILE_TICKS_PER_US 1000
+#elif defined(PROFILE_INTERVAL_TIMER)
+#define PROFILE_TICKS_PER_US 100
+#else
+#define PROFILE_TICKS_PER_US 800
+#endif
+
+struct trace_event {
+    uint32_t start;
+    uint32_t duration;
+    uint32_t stage;
+};
+
+struct trace_ring {
+    volatile unsigned int head;
+    struct trace_event events[TRACE_SIZE];
+};
+
+struct trace_ring trace;
+uint32_t frame_start;
+
+static const char *stage_names[NUM_STAGES] = {
+    "frame", "clear", "snowman", "sphere", "text", "input", "audio", "vsync", "raster", "particles", "capture"
+};
+
+static inline uint32_t profile_now(){
+#if defined(HOST_SIM)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#elif defined(PROFILE_INTERVAL_TIMER)
+    return clock_ticks();
+#else
+    uint32_t cycles;
+    asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(cycles));     // PMCCNTR
+    return cycles;
+#endif
+}
+
+#ifdef HOST_SIM
+FILE *profile_out;
+void profile_dump();
+
+static void profile_exit(){
+    const char *path = getenv("HANGMAN_PROFILE");
+    if (path && (profile_out = fopen(path, "w")) == NULL)
+        perror(path);
+    profile_dump();
+    if (profile_out)
+        fclose(profile_out);
+}
+#endif
+
+void profile_init(){
+#ifdef HOST_SIM
+    atexit(profile_exit);
+#endif
+#if !defined(HOST_SIM) && !defined(PROFILE_INTERVAL_TIMER)     // the timer is started by clock_init
+    asm volatile("mcr p15, 0, %0, c9, c12, 0" : : "r"(0x5));       // PMCR: enable, reset cycle counter
+    asm volatile("mcr p15, 0, %0, c9, c12, 1" : : "r"(1u << 31));  // PMCNTENSET: cycle counter
+#endif
+    frame_start = profile_now();
+}
+
+void trace_record(int stage, uint32_t start){
+    uint32_t end = profile_now();
+    unsigned int slot = __sync_fetch_and_add(&trace.head, 1) & (TRACE_SIZE - 1);
+    trace.events[slot].start = start;
+    trace.events[slot].duration = end - start;
+    trace.events[slot].stage = stage;
+}
+
+#define PROBE_BEGIN(stage) uint32_t probe_##stage = profile_now()
+#define PROBE_END(stage) trace_record(stage, probe_##stage)
+#define PROBE_FRAME() do { trace_record(STAGE_FRAME, frame_start); frame_start = profile_now(); } while (0)
+
+void profile_write(const char *text){
+#ifdef HOST_SIM
+    fputs(text, profile_out ? profile_out : stderr);
+#else
+    uart_write(text, strlen(text));
+#endif
+}
+
+void profile_dump(){
+    struct stage_stats {
+        uint32_t count;
+        uint64_t total;
+        uint32_t max;
+        uint32_t histogram[PROFILE_BUCKETS];
+    } stats[NUM_STAGES];
+    struct trace_event worst[PROFILE_WORST_FRAMES];
+    char line[160];
+
+    memset(stats, 0, sizeof(stats));
+    memset(worst, 0, sizeof(worst));
+    unsigned int head = trace.head;
+    unsigned int count = head < TRACE_SIZE ? head : TRACE_SIZE;
+    for (unsigned int i = head - count; i != head; i++){
+        struct trace_event event = trace.events[i & (TRACE_SIZE - 1)];
+        if (event.stage >= NUM_STAGES)
+            continue;
+        struct stage_stats *st = &stats[event.stage];
+        uint32_t us = event.duration / PROFILE_TICKS_PER_US;
+        int bucket = 0;
+        while (bucket < PROFILE_BUCKETS - 1 && us >= (1u << bucket))
+            bucket++;
+        st->count++;
+        st->total += event.duration;
+        if (event.duration > st->max)
+            st->max = event.duration;
+        st->histogram[bucket]++;
+        if (event.stage == STAGE_FRAME && event.duration > worst[PROFILE_WORST_FRAMES - 1].duration){
+            int j = PROFILE_WORST_FRAMES - 1;
+            for (; j > 0 && worst[j - 1].duration < event.duration; j--)
+                worst[j] = worst[j - 1];
+            worst[j] = event;
+        }
+    }
 
+    int width = 0;      // of the stage column
+    for (int s = 0; s < NUM_STAGES; s++)
+        width = MAX(width, (int)strlen(stage_names[s]));
+    snprintf(line, sizeof(line), "profile: last %u events\n%-*s %7s %9s %9s  histogram (<1us <2us <4us ...)\n",
+             count, width, "stage", "count", "mean_us", "max_us");
+    profile_write(line);
+    for (int s = 0; s < NUM_STAGES; s++){
+        struct stage_stats *st = &stats[s];
+        if (st->count == 0)
+            continue;
+        int n = snprintf(line, sizeof(line), "%-*s %7u %9.1f %9.1f ", width, stage_names[s], (unsigned)st->count,
+                         (double)st->total / st->count / PROFILE_TICKS_PER_US, (double)st->max / PROFILE_TICKS_PER_US);
+        for (int b = 0; b < PROFILE_BUCKETS && n < (int)sizeof(line) - 12; b++)
+            n += snprintf(line + n, sizeof(line) - n, " %u", (unsigned)st->histogram[b]);
+        snprintf(line + n, sizeof(line) - n, "\n");
+        profile_write(line);
+    }
+    for (int j = 0; j < PROFILE_WORST_FRAMES && worst[j].duration; j++){
+        snprintf(line, sizeof(line), "worst frame %d: %.1f us\n", j + 1, (double)worst[j].duration / PROFILE_TICKS_PER_US);
+        profile_write(line);
+    }
+}
+#else
+#define PROBE_BEGIN(stage)
+#define PROBE_END(stage)
+#define PROBE_FRAME()
+#define profile_init()
+#define profile_dump()
+#endif
+
+
+/* The buffer this frame is drawn into. Only show_frame (and on the render
+ * core, nothing at all) moves it on, so the drawing code can keep it in
+ * registers. Targets past the pixel buffers are the compositor's layers,
+ * which have the same row pitch, so everything can be drawn into them. */
+#define NUM_LAYERS 3
+#define NUM_TARGETS (NUM_PIXEL_BUFFERS + NUM_LAYERS)
+
+struct render_target {
+    int index;              // into pixel_buffers, or NUM_PIXEL_BUFFERS + a layer
+    char *pixels;
+};
+
+const int pixel_buffers[NUM_PIXEL_BUFFERS] = {
+    FPGA_ONCHIP_BASE, SDRAM_BASE, SDRAM_BASE + PIXEL_BUFFER_BYTES
+};
+
+uint16_t layer_pixels[NUM_LAYERS][RESOLUTION_Y << 9] __attribute__((aligned(16)));
+
+struct render_target back_buffer;
+
+char *target_pixels(int index){
+    if (index < NUM_PIXEL_BUFFERS)
+        return MEM_ADDR(pixel_buffers[index]);
+    return (char *)layer_pixels[index - NUM_PIXEL_BUFFERS];
+}
 
-int* letter_states;
-char wrong_guesses [1000] = "";
-volatile int pixel_buffer_start; // global variable
+void select_target(int index){
+    back_buffer.index = index;
+    back_buffer.pixels = target_pixels(index);
+}
 
 // code for subroutines (not shown)
 
+/* Screen rectangle, x1 and y1 are exclusive. */
+struct rect {
+    int x0, y0, x1, y1;
+};
+
+/* Rectangles changed since a pixel buffer was last drawn. Every change is
+ * recorded for all buffers, because the buffers are drawn in turn and each
+ * one must catch up when it comes round again. */
+struct damage_list {
+    int count;
+    struct rect rects[MAX_DAMAGE_RECTS];
+};
+
+void damage_add(struct damage_list lists[NUM_PIXEL_BUFFERS], int x0, int y0, int x1, int y1){
+    struct rect r = {MAX(x0, 0), MAX(y0, 0), MIN(x1, RESOLUTION_X), MIN(y1, RESOLUTION_Y)};
+    if (r.x0 >= r.x1 || r.y0 >= r.y1)
+        return;
+    for (int b = 0; b < NUM_PIXEL_BUFFERS; b++){
+        struct damage_list *list = &lists[b];
+        int i;
+        for (i = 0; i < list->count; i++){
+            struct rect *d = &list->rects[i];
+            if (d->x0 <= r.x0 && d->y0 <= r.y0 && d->x1 >= r.x1 && d->y1 >= r.y1)
+                break;      // already covered
+        }
+        if (i < list->count)
+            continue;
+        if (list->count < MAX_DAMAGE_RECTS){
+            list->rects[list->count++] = r;
+        } else {
+            // out of slots, grow the last rectangle to cover the new one
+            struct rect *d = &list->rects[MAX_DAMAGE_RECTS - 1];
+            if (r.x0 < d->x0) d->x0 = r.x0;
+            if (r.y0 < d->y0) d->y0 = r.y0;
+            if (r.x1 > d->x1) d->x1 = r.x1;
+            if (r.y1 > d->y1) d->y1 = r.y1;
+        }
+    }
+}
+
+/* Compositor layers, bottom to top. Each is an off-screen image that is
+ * drawn only when its content changes and tracks, per pixel buffer, what
+ * changed since that buffer was last composed. The word and guesses are not
+ * a layer here: they are in the character buffer, which the VGA controller
+ * already overlays on every frame. */
+enum layer_id {
+    LAYER_BACKGROUND,       // opaque
+    LAYER_SNOWMAN,          // the snowman as it stands
+    LAYER_EFFECTS           // moving parts and particles
+};
+
+struct layer {
+    uint16_t key;           // pixels of this colour show the layers below
+    struct damage_list damage[NUM_PIXEL_BUFFERS];
+};
+
+struct layer layers[NUM_LAYERS];        // every key is black
+
+/* Display list. The draw functions don't write pixels; they record a command
+ * clipped to the screen rows, and display_list_flush rasterizes the recorded
+ * commands when the frame is presented or its pixels are read back. The
+ * screen is drawn in bands of DL_BAND_ROWS rows, top to bottom: every command
+ * that touches a band draws its rows of the band, in recording order, so
+ * overdraw comes out as before while the band stays in the cache. The
+ * rasterizers clip columns too, nothing outside the screen is written. */
+#define DL_MAX_COMMANDS 256
+#define DL_TEXT_SIZE 1024
+#define DL_MAX_POINTS 4096
+#define DL_POINT_WORDS (DL_MAX_POINTS + DL_MAX_POINTS / 2)    // positions and colours
+#define DL_BAND_ROWS 16
+
+enum draw_op {
+    OP_RECT,        // a, c: x0 and x1, exclusive and clipped
+    OP_CIRCLE,      // a, b, c: centre x, y and radius
+    OP_LINE,        // a, b, c, d: x0, y0, x1, y1 as given to draw_line
+    OP_GLYPHS,      // a, b, c: x, y and length of the text in data
+    OP_SPRITE,      // data: a snowman area sprite, columns a <= x < c
+    OP_POINTS,      // data: c positions (y << 16 | x) sorted by row, then c colours
+    OP_COMPOSE      // a, c: x0 and x1 of the rows to merge from the layers
+};
+
+struct draw_cmd {
+    uint8_t op;
+    uint16_t color;
+    int16_t y0, y1;         // rows touched, y0 <= y < y1, clipped to the screen
+    int16_t a, b, c, d;
+    const void *data;
+};
+
+struct display_list {
+    int target;             // index of the pixel buffer the commands are drawn into
+    int present;            // show the buffer once the commands are drawn
+    int count;
+    int text_used;
+    int points_used;        // words of points
+    struct draw_cmd cmds[DL_MAX_COMMANDS];
+    char text[DL_TEXT_SIZE];
+    uint32_t points[DL_POINT_WORDS];
+};
+
+#ifdef DUAL_CORE
+#define NUM_DISPLAY_LISTS 3     // being recorded, handed over, being rasterized
+#else
+#define NUM_DISPLAY_LISTS 1
+#endif
+
+struct display_list display_lists[NUM_DISPLAY_LISTS];
+struct display_list *display_list = &display_lists[0];     // the one being recorded
+
+void display_list_flush();
+void display_list_finish();
+
+struct draw_cmd *dl_push(int op, int y0, int y1, short int color){
+    // Record a command that touches rows y0 <= y < y1, NULL if none is on screen
+    if (y0 < 0)
+        y0 = 0;
+    if (y1 > RESOLUTION_Y)
+        y1 = RESOLUTION_Y;
+    if (y0 >= y1)
+        return NULL;
+    if (display_list->count == DL_MAX_COMMANDS ||
+        (display_list->count != 0 && display_list->target != back_buffer.index))
+        display_list_flush();
+    display_list->target = back_buffer.index;
+    struct draw_cmd *cmd = &display_list->cmds[display_list->count++];
+    cmd->op = op;
+    cmd->color = color;
+    cmd->y0 = y0;
+    cmd->y1 = y1;
+    return cmd;
+}
+
+void fill_row(uint16_t *p, int n, short int color){
+    // 16-bit stores up to an 8 byte boundary, then the widest stores available
+    uint32_t pair = (uint16_t)color * 0x00010001u;
+    while (n > 0 && ((uintptr_t)p & 7) != 0){
+        *p++ = color;
+        n--;
+    }
+#ifdef __ARM_NEON
+    uint16x8_t wide = vdupq_n_u16((uint16_t)color);
+    for (; n >= 8; n -= 8){
+        vst1q_u16(p, wide);
+        p += 8;
+    }
+#else
+    // memcpy, not a uint64_t store: the pixels are read back as uint16_t
+    uint64_t quad = ((uint64_t)pair << 32) | pair;
+    for (; n >= 4; n -= 4){
+        memcpy(p, &quad, sizeof(quad));
+        p += 4;
+    }
+#endif
+    for (; n >= 2; n -= 2){
+        memcpy(p, &pair, sizeof(pair));
+        p += 2;
+    }
+    if (n){
+        *p = color;
+    }
+}
+
+void fill_rect(int x0, int y0, int x1, int y1, short int color){
+    // Fill x0 <= x < x1, y0 <= y < y1
+    x0 = MAX(x0, 0);
+    x1 = MIN(x1, RESOLUTION_X);
+    if (x0 >= x1)
+        return;
+    struct draw_cmd *cmd = dl_push(OP_RECT, y0, y1, color);
+    if (cmd == NULL)
+        return;
+    cmd->a = x0;
+    cmd->c = x1;
+}
+
 void plot_pixel(int x, int y, short int line_color){
-    *(short int *)(pixel_buffer_start + (y << 10) + (x << 1)) = line_color;
+    fill_rect(x, y, x + 1, y + 1, line_color);
 }
 
-void clear_screen(){
-    for (int i = 0; i < RESOLUTION_X; i++){
-        for (int j = 0; j < RESOLUTION_Y; j++){
-            plot_pixel(i, j, 0x0000);
-        }
+void raster_span(char *buffer, int x0, int x1, int y, short int color){
+    // Pixels x0 <= x < x1 of row y, clipped
+    x0 = MAX(x0, 0);
+    x1 = MIN(x1, RESOLUTION_X);
+    if (x0 < x1)
+        fill_row((uint16_t *)(buffer + (y << 10)) + x0, x1 - x0, color);
+}
+
+void raster_rect(char *buffer, const struct draw_cmd *cmd, int y0, int y1){
+    char *row = buffer + (y0 << 10);
+    for (int y = y0; y < y1; y++){
+        fill_row((uint16_t *)row + cmd->a, cmd->c - cmd->a, cmd->color);
+        row += 1 << 10;
     }
 }
 
+void clear_screen(){
+    PROBE_BEGIN(STAGE_CLEAR);
+    fill_rect(0, 0, RESOLUTION_X, RESOLUTION_Y, 0x0000);
+    PROBE_END(STAGE_CLEAR);
+}
+
 void clear_snowman(){
-    for (int i = 130; i < RESOLUTION_X; i++){
-        for (int j = 0; j < RESOLUTION_Y; j++){
-            plot_pixel(i, j, 0x0000);
-            
+    PROBE_BEGIN(STAGE_CLEAR);
+    fill_rect(SNOWMAN_AREA_X, 0, RESOLUTION_X, RESOLUTION_Y, 0x0000);
+    PROBE_END(STAGE_CLEAR);
+}
+/* Audio. Sounds are voices mixed from single-cycle wavetables and fed to the
+ * codec from the audio interrupt, which fires when the write FIFOs are at
+ * least 75% empty and only tops them up with as many samples as they have
+ * room for. Starting a sound returns immediately. The main loop only starts
+ * voices and the interrupt handler only advances and ends them; a voice is
+ * handed over by setting its active flag last. */
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_AMPLITUDE 0x00FFFFFF
+#define WAVETABLE_SIZE 256
+#define MAX_VOICES 4
+
+enum waveform { WAVE_SQUARE, WAVE_TRIANGLE, NUM_WAVEFORMS };
+
+struct voice {
+    const int *table;
+    unsigned int phase;         // position in the table, 8.24 fixed point
+    unsigned int step;          // phase increment per sample
+    volatile int remaining;     // samples left to play
+    volatile int active;
+};
+
+int wavetables[NUM_WAVEFORMS][WAVETABLE_SIZE];
+int wavetables_ready = FALSE;
+struct voice voices[MAX_VOICES];
+
+void build_wavetables(){
+    for (int i = 0; i < WAVETABLE_SIZE; i++){
+        wavetables[WAVE_SQUARE][i] = (i < WAVETABLE_SIZE / 2) ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+        // rises from -A to A over the first half, falls back over the second
+        int ramp = (i < WAVETABLE_SIZE / 2) ? i : WAVETABLE_SIZE - i;
+        wavetables[WAVE_TRIANGLE][i] = -AUDIO_AMPLITUDE + (int)(((long long)2 * AUDIO_AMPLITUDE * ramp) / (WAVETABLE_SIZE / 2));
+    }
+    wavetables_ready = TRUE;
+}
+
+void audio_isr(){
+    PROBE_BEGIN(STAGE_AUDIO);
+    int fifospace = IO_READ(AUDIO_BASE + 4);
+    int space = (fifospace >> 16) & 0xFF;           // WSRC
+    if (((fifospace >> 24) & 0xFF) < space)         // WSLC
+        space = (fifospace >> 24) & 0xFF;
+
+    int playing = 0;
+    for (; space > 0; space--){
+        int sample = 0;
+        playing = 0;
+        for (int v = 0; v < MAX_VOICES; v++){
+            struct voice *voice = &voices[v];
+            if (!voice->active)
+                continue;
+            sample += voice->table[voice->phase >> 24];
+            voice->phase += voice->step;
+            if (--voice->remaining <= 0)
+                voice->active = FALSE;
+            else
+                playing++;
         }
+        IO_WRITE(AUDIO_BASE + 8, sample);
+        IO_WRITE(AUDIO_BASE + 12, sample);
+    }
+    if (!playing){
+        for (int v = 0; v < MAX_VOICES; v++)
+            playing |= voices[v].active;
+        if (!playing)
+            IO_WRITE(AUDIO_BASE, 0);    // nothing left to play, stop the write interrupt
     }
+    PROBE_END(STAGE_AUDIO);
 }
+
+void play_tone(enum waveform waveform, int frequency, int duration) {
+    // Start a tone of frequency Hz for duration ms without waiting for it.
+    // If every voice is busy the tone is dropped.
+    if (!wavetables_ready)
+        build_wavetables();
+    for (int v = 0; v < MAX_VOICES; v++){
+        struct voice *voice = &voices[v];
+        if (voice->active)
+            continue;
+        voice->table = wavetables[waveform];
+        voice->phase = 0;
+        voice->step = (unsigned int)(((unsigned long long)frequency << 32) / AUDIO_SAMPLE_RATE);
+        voice->remaining = duration * (AUDIO_SAMPLE_RATE / 1000);
+        __sync_synchronize();
+        voice->active = TRUE;
+        IO_WRITE(AUDIO_BASE, 0x2);      // WE: interrupt when the write FIFOs have room
+        return;
+    }
+}
+
 void play_sound(int frequency, int duration) {
-    volatile int *audio_ptr = (int *)AUDIO_BASE;
-    int sample_rate = 48000; // 48 kHz
-    int num_samples = duration * sample_rate / 1000;
-    int half_period = sample_rate / (2 * frequency);
-
-    for (int i = 0; i < num_samples; ++i) {
-        if (i % (2 * half_period) < half_period) {
-            *(audio_ptr + 2) = 0x00FFFFFF; // max positive value
-            *(audio_ptr + 3) = 0x00FFFFFF;
-        } else {
-            *(audio_ptr + 2) = 0xFF000000; // max negative value
-            *(audio_ptr + 3) = 0xFF000000;
+    play_tone(WAVE_SQUARE, frequency, duration);
+}
+
+void stop_sounds(){
+    IO_WRITE(AUDIO_BASE, 0x8);      // disable the interrupt and clear the write FIFOs
+    for (int v = 0; v < MAX_VOICES; v++)
+        voices[v].active = FALSE;
+    IO_WRITE(AUDIO_BASE, 0);
+}
+
+
+/* Frame capture. Built with -DCAPTURE, every frame is encoded as it reaches
+ * the screen, so what the board shows can be watched without a VGA capture
+ * card (tools/capplay rebuilds the frames). The frame is XORed against the
+ * one shown before it, which is still untouched in the previous pixel
+ * buffer, so nothing is copied: of the 16x16 tiles only those with a
+ * nonzero difference are sent, each as runs of XOR values. Comparing stops
+ * at the first differing word of a tile, so unchanged tiles cost one read
+ * of each buffer. A frame whose previous buffer isn't available (the first
+ * one, or after a dropped frame) is a key frame, XORed against black.
+ *
+ * The stream is "HGCS", a version byte (1), the width and height as 16-bit
+ * little endian and the tile size, then per frame: its length in bytes, the
+ * number of frames presented before it and the milliseconds since the last
+ * captured frame as LEB128 varints, a flags byte (1 key frame), a bitmap of
+ * the tiles sent (row-major, bit 0 first) and each tile's runs, row-major:
+ * a varint (length << 1 | 1) followed by one value repeated, or (length << 1)
+ * followed by that many values, each 16-bit little endian.
+ *
+ * On the host the stream goes to the file HANGMAN_CAPTURE, or with
+ * "unix:<path>" to a Unix socket that a player listens on. On the board it
+ * goes out of the JTAG UART through the output ring. A frame that doesn't
+ * fit in the ring is dropped and the next one is a key frame. Only the pixel
+ * buffer is captured, not the character overlay. */
+#ifdef CAPTURE
+#define CAPTURE_TILE 16
+#define CAPTURE_TILES_X (RESOLUTION_X / CAPTURE_TILE)
+#define CAPTURE_TILES (CAPTURE_TILES_X * (RESOLUTION_Y / CAPTURE_TILE))
+#define CAPTURE_MIN_REPEAT 3    // shorter runs are cheaper as literals
+#define CAPTURE_HEADER 16       // room for the frame's varints and flags
+#define CAPTURE_MAX_FRAME (CAPTURE_HEADER + (CAPTURE_TILES + 7) / 8 + CAPTURE_TILES * (3 + 2 * CAPTURE_TILE * CAPTURE_TILE))
+
+#ifdef HOST_SIM
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+FILE *capture_out;
+#endif
+
+uint8_t capture_buffer[CAPTURE_MAX_FRAME];
+static const uint16_t capture_black[CAPTURE_TILE] __attribute__((aligned(8)));
+int capture_previous = -1;      // buffer captured last, -1 for a key frame next
+uint32_t capture_frames;        // frames presented, including dropped ones
+uint32_t capture_time;          // clock_ticks() at the last captured frame
+
+static uint8_t *capture_varint(uint8_t *out, uint32_t value){
+    while (value >= 0x80){
+        *out++ = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+static uint8_t *capture_values(uint8_t *out, const uint16_t *values, int count){
+    // a literal run
+    if (count == 0)
+        return out;
+    out = capture_varint(out, count << 1);
+    for (int i = 0; i < count; i++){
+        *out++ = values[i] & 0xFF;
+        *out++ = values[i] >> 8;
+    }
+    return out;
+}
+
+static int capture_tile_changed(const char *now, const char *before, int before_pitch){
+    // 64 bits at a time, loaded with memcpy since the pixels are uint16_t
+    for (int row = 0; row < CAPTURE_TILE; row++){
+        const char *a = now + (row << 10);
+        const char *b = before + row * before_pitch;
+        uint64_t diff = 0;
+        for (int i = 0; i < CAPTURE_TILE * 2; i += 8){
+            uint64_t x, y;
+            memcpy(&x, a + i, sizeof(x));
+            memcpy(&y, b + i, sizeof(y));
+            diff |= x ^ y;
+        }
+        if (diff)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static uint8_t *capture_tile(uint8_t *out, const char *now, const char *before, int before_pitch){
+    uint16_t delta[CAPTURE_TILE * CAPTURE_TILE];
+    for (int row = 0; row < CAPTURE_TILE; row++){
+        const uint16_t *a = (const uint16_t *)(now + (row << 10));
+        const uint16_t *b = (const uint16_t *)(before + row * before_pitch);
+        for (int i = 0; i < CAPTURE_TILE; i++)
+            delta[row * CAPTURE_TILE + i] = a[i] ^ b[i];
+    }
+    int n = CAPTURE_TILE * CAPTURE_TILE;
+    int literal = 0;        // first value not written yet
+    for (int i = 0; i < n; ){
+        int run = 1;
+        while (i + run < n && delta[i + run] == delta[i])
+            run++;
+        if (run < CAPTURE_MIN_REPEAT){
+            i += run;
+            continue;
         }
+        out = capture_values(out, delta + literal, i - literal);
+        out = capture_varint(out, run << 1 | 1);
+        *out++ = delta[i] & 0xFF;
+        *out++ = delta[i] >> 8;
+        i += run;
+        literal = i;
     }
+    return capture_values(out, delta + literal, n - literal);
+}
+
+static int capture_emit(const uint8_t *data, int size){
+#ifdef HOST_SIM
+    if (fwrite(data, 1, size, capture_out) == (size_t)size)
+        return TRUE;
+    perror("HANGMAN_CAPTURE");
+    fclose(capture_out);
+    capture_out = NULL;
+    return FALSE;
+#else
+    return uart_write(data, size);
+#endif
 }
 
+void capture_frame(int index){
+    // Encode pixel_buffers[index], which has just reached the screen
+#ifdef HOST_SIM
+    if (!capture_out)
+        return;
+#endif
+    PROBE_BEGIN(STAGE_CAPTURE);
+    const char *now = target_pixels(index);
+    const char *before = (const char *)capture_black;
+    int before_pitch = 0;
+    int key = capture_previous < 0 || capture_previous == index;
+    if (!key){
+        before = target_pixels(capture_previous);
+        before_pitch = 1 << 10;
+    }
+    uint32_t ticks = clock_ticks();
+    uint8_t *body = capture_buffer + CAPTURE_HEADER;
+    uint8_t *out = capture_varint(body, capture_frames);
+    out = capture_varint(out, capture_frames ? (ticks - capture_time) / CLOCK_TICKS_PER_MS : 0);
+    *out++ = key;
+    uint8_t *bitmap = out;
+    memset(bitmap, 0, (CAPTURE_TILES + 7) / 8);
+    out += (CAPTURE_TILES + 7) / 8;
+    for (int tile = 0; tile < CAPTURE_TILES; tile++){
+        int offset = ((tile / CAPTURE_TILES_X * CAPTURE_TILE) << 10) + ((tile % CAPTURE_TILES_X * CAPTURE_TILE) << 1);
+        int before_offset = before_pitch ? offset : 0;
+        if (!capture_tile_changed(now + offset, before + before_offset, before_pitch))
+            continue;
+        bitmap[tile >> 3] |= 1 << (tile & 7);
+        out = capture_tile(out, now + offset, before + before_offset, before_pitch);
+    }
+    // the length goes in front of the body
+    uint8_t length[5];
+    int length_size = capture_varint(length, out - body) - length;
+    body -= length_size;
+    memcpy(body, length, length_size);
+    capture_previous = capture_emit(body, out - body) ? index : -1;
+    capture_frames++;
+    capture_time = ticks;
+    PROBE_END(STAGE_CAPTURE);
+}
+
+#ifdef HOST_SIM
+static void capture_exit(){
+    if (capture_out)
+        fclose(capture_out);
+}
+#endif
+
+void capture_init(){
+#ifdef HOST_SIM
+    const char *path = getenv("HANGMAN_CAPTURE");
+    if (!path)
+        return;
+    if (strncmp(path, "unix:", 5) == 0){
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        strncpy(addr.sun_path, path + 5, sizeof(addr.sun_path) - 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || !(capture_out = fdopen(fd, "wb"))){
+            perror(path);
+            if (fd >= 0)
+                close(fd);
+            return;
+        }
+        signal(SIGPIPE, SIG_IGN);      // a player that goes away is a write error
+    } else if (!(capture_out = fopen(path, "wb"))){
+        perror(path);
+        return;
+    }
+    atexit(capture_exit);
+#endif
+    static const uint8_t header[] = {
+        'H', 'G', 'C', 'S', 1, RESOLUTION_X & 0xFF, RESOLUTION_X >> 8, RESOLUTION_Y & 0xFF, RESOLUTION_Y >> 8, CAPTURE_TILE
+    };
+    capture_emit(header, sizeof(header));
+}
+#else
+#define capture_init()
+#define capture_frame(index)
+#endif
+
+
+/* Presentation. The buffers are shown in turn: while one is on screen and
+ * the next is waiting for vsync, the third is free to draw. A swap request
+ * is written and left to complete on its own; the status register is only
+ * polled, and present blocks only when a finished frame finds the previous
+ * swap still pending, i.e. when drawing runs ahead of the display. */
+int front_buffer;               // index of the buffer on screen
+int pending_buffer = -1;        // swap requested, shown from the next vsync
+
+int present_poll(){
+    // TRUE while a requested swap hasn't happened yet
+    if (pending_buffer >= 0 && (IO_READ(PIXEL_BUF_CTRL_BASE + 12) & 0x01) == 0){
+        front_buffer = pending_buffer;
+        pending_buffer = -1;
+        capture_frame(front_buffer);
+    }
+    uart_drain();
+    return pending_buffer >= 0;
+}
 
-void wait_for_vsync(){
-    volatile int * pixel_ctrl_ptr = (int *)0xFF203020;
-    register int status;
-    *pixel_ctrl_ptr = 1;
-    status = *(pixel_ctrl_ptr + 3);
-    while ((status & 0x01) != 0){
-        status = *(pixel_ctrl_ptr + 3);
+void present(int index){
+    // Show pixel_buffers[index] from the next vsync
+    if (present_poll()){
+        PROBE_BEGIN(STAGE_VSYNC);
+        while (present_poll())
+            ;
+        PROBE_END(STAGE_VSYNC);
     }
+    IO_WRITE(PIXEL_BUF_CTRL_BASE + 4, pixel_buffers[index]);
+    IO_WRITE(PIXEL_BUF_CTRL_BASE, 1);
+    pending_buffer = index;
+    PROBE_FRAME();
+}
+
+
+/* PS/2 input. The PS/2 interrupt handler moves every received byte from the
+ * port's FIFO into ps2_ring; the game loop drains the ring without blocking.
+ * The ring has a single producer (the handler) and a single consumer (the
+ * main loop), so head and tail are each written by one side only. */
+#define PS2_RING_SIZE 256       // power of two
+
+struct ps2_ring {
+    volatile unsigned int head;     // written by the handler
+    volatile unsigned int tail;     // written by the main loop
+    volatile unsigned int dropped;
+    unsigned char data[PS2_RING_SIZE];
+};
+
+struct ps2_ring ps2_ring;
+
+void ps2_isr(){
+    int data = IO_READ(PS2_BASE);
+    while (data & 0x8000){
+        unsigned int head = ps2_ring.head;
+        if (head - ps2_ring.tail == PS2_RING_SIZE){
+            ps2_ring.dropped++;
+        } else {
+            ps2_ring.data[head & (PS2_RING_SIZE - 1)] = data & 0xFF;
+            __sync_synchronize();   // publish the byte before the new head
+            ps2_ring.head = head + 1;
+        }
+        data = IO_READ(PS2_BASE);
+    }
+}
+
+int ps2_ring_pop(){
+    // Returns the oldest scancode byte, or -1 if nothing was received
+    unsigned int tail = ps2_ring.tail;
+    if (tail == ps2_ring.head)
+        return -1;
+    __sync_synchronize();
+    int code = ps2_ring.data[tail & (PS2_RING_SIZE - 1)];
+    __sync_synchronize();   // finish reading the byte before releasing its slot
+    ps2_ring.tail = tail + 1;
+    return code;
+}
+
+void ps2_ring_flush(){
+    ps2_ring.tail = ps2_ring.head;
+}
+
+#ifndef HOST_SIM
+/* Exception handling for the A9, as in the Intel "Using the ARM Generic
+ * Interrupt Controller" tutorial. Only the PS/2 and audio interrupts are used. */
+#define INT_ENABLE 0b01000000
+#define INT_DISABLE 0b11000000
+#define IRQ_MODE 0b10010
+#define SVC_MODE 0b10011
+
+void __attribute__((interrupt)) __cs3_isr_irq(void){
+    int interrupt_ID = *((int *)(MPCORE_GIC_CPUIF + 0x0C));    // ICCIAR
+    if (interrupt_ID == PS2_IRQ)
+        ps2_isr();
+    else if (interrupt_ID == AUDIO_IRQ)
+        audio_isr();
+    else
+        while (1);
+    *((int *)(MPCORE_GIC_CPUIF + 0x10)) = interrupt_ID;       // ICCEOIR
+}
+
+void __attribute__((interrupt)) __cs3_reset(void){ while (1); }
+void __attribute__((interrupt)) __cs3_isr_undef(void){ while (1); }
+void __attribute__((interrupt)) __cs3_isr_swi(void){ while (1); }
+void __attribute__((interrupt)) __cs3_isr_pabort(void){ while (1); }
+void __attribute__((interrupt)) __cs3_isr_dabort(void){ while (1); }
+void __attribute__((interrupt)) __cs3_isr_fiq(void){ while (1); }
+
+void set_A9_IRQ_stack(){
+    int stack = A9_ONCHIP_END - 7;      // top of A9 on-chip memory, 8 byte aligned
+    int mode = INT_DISABLE | IRQ_MODE;
+    asm("msr cpsr, %[ps]" : : [ps] "r"(mode));
+    asm("mov sp, %[ps]" : : [ps] "r"(stack));
+    mode = INT_DISABLE | SVC_MODE;      // back to SVC mode before returning
+    asm("msr cpsr, %[ps]" : : [ps] "r"(mode));
+}
+
+void enable_A9_interrupts(){
+    int status = SVC_MODE | INT_ENABLE;
+    asm("msr cpsr, %[ps]" : : [ps] "r"(status));
+}
+
+void config_interrupt(int N, int CPU_target){
+    // set-enable bit in ICDISERn, then the target CPU in ICDIPTRn
+    *(int *)(MPCORE_GIC_DIST + 0x100 + ((N >> 3) & 0xFFFFFFFC)) |= 1 << (N & 0x1F);
+    *(char *)(MPCORE_GIC_DIST + 0x800 + N) = (char)CPU_target;
+}
+
+void config_GIC(){
+    config_interrupt(PS2_IRQ, 1);
+    config_interrupt(AUDIO_IRQ, 1);
+    *((int *)(MPCORE_GIC_CPUIF + 0x04)) = 0xFFFF;  // ICCPMR: allow all priorities
+    *((int *)MPCORE_GIC_CPUIF) = 1;                // ICCICR: signal interrupts to the CPU
+    *((int *)MPCORE_GIC_DIST) = 1;                 // ICDDCR: forward pending interrupts
+}
+#endif
+
+void init_interrupts(){
+#ifdef HOST_SIM
+    sim_set_irq_handler(PS2_IRQ, ps2_isr);
+    sim_set_irq_handler(AUDIO_IRQ, audio_isr);
+#else
+    set_A9_IRQ_stack();
+    config_GIC();
+#endif
+    IO_WRITE(PS2_BASE + 4, 1);      // RE: interrupt when data is received
+#ifndef HOST_SIM
+    enable_A9_interrupts();
+#endif
 }
 
 
@@ -136,6 +1083,19 @@ void swap(int *x0, int *y0)
 
 void draw_line(int x0, int y0, int x1, int y1, short int color)
 {
+    struct draw_cmd *cmd = dl_push(OP_LINE, MIN(y0, y1), MAX(y0, y1) + 1, color);
+    if (cmd == NULL)
+        return;
+    cmd->a = x0;
+    cmd->b = y0;
+    cmd->c = x1;
+    cmd->d = y1;
+}
+void raster_line(char *buffer, const struct draw_cmd *cmd, int band_y0, int band_y1)
+{
+    // Bresenham, writing only the pixels in rows band_y0..band_y1
+    int x0 = cmd->a, y0 = cmd->b, x1 = cmd->c, y1 = cmd->d;
+    uint16_t color = cmd->color;
     int is_steep = ABS(y1 - y0) > ABS(x1 - x0);
     if (is_steep)
     {
@@ -162,16 +1122,44 @@ void draw_line(int x0, int y0, int x1, int y1, short int color)
         y_step = -1;
     }
 
+    // Jump to the first step that can reach the band. After k > 0 steps the
+    // minor coordinate has moved (error0 + k * deltay + deltax) / deltax
+    // times and the error is back in [-deltax, 0).
+    int k = 0;
+    if (is_steep)
+    {
+        k = band_y0 - x0;
+    }
+    else
+    {
+        int rows = (y_step > 0) ? band_y0 - y0 : y0 - (band_y1 - 1);
+        if (rows > 0 && deltay > 0)
+        {
+            int64_t steps = (int64_t)(rows - 1) * deltax - error;
+            k = MAX((int)((steps + deltay - 1) / deltay), 1);
+        }
+        k = MAX(k, -x0);
+    }
+    if (k > 0)
+    {
+        int64_t moved = (int64_t)error + (int64_t)k * deltay + deltax;
+        int m = deltax ? (int)(moved / deltax) : 0;
+        y = y0 + y_step * m;
+        error = (int)(moved - deltax - (int64_t)m * deltax);
+    }
+
     int x;
-    for (x = x0; x < x1; ++x)
+    for (x = x0 + MAX(k, 0); x < x1; ++x)
     {
-        if (is_steep)
+        int px = is_steep ? y : x;
+        int py = is_steep ? x : y;
+        if (py >= band_y1 || (!is_steep && y_step < 0 && py < band_y0) || (!is_steep && px >= RESOLUTION_X))
         {
-            plot_pixel(y, x, color);
+            break;      // past the band or the screen
         }
-        else
+        if (py >= band_y0 && px >= 0 && px < RESOLUTION_X)
         {
-            plot_pixel(x, y, color);
+            *((uint16_t *)(buffer + (py << 10)) + px) = color;
         }
 
         error = error + deltay;
@@ -183,26 +1171,200 @@ void draw_line(int x0, int y0, int x1, int y1, short int color)
     }
 }
 
+void draw_span(int x0, int x1, int y, short int color)
+{
+    // Fill pixels x0..x1 (inclusive) of row y
+    fill_rect(x0, y, x1 + 1, y + 1, color);
+}
+
 void draw_sphere(int x, int y, int radius, short int color)
 {
-    int x0 = x - radius;
-    int x1 = x + radius;
-    int y0 = y - radius;
-    int y1 = y + radius;
-    int i, j;
-    for (i = x0; i <= x1; i++)
+    // Filled circle of all pixels with dx*dx + dy*dy <= radius*radius
+    if (radius < 0)
+        return;
+    PROBE_BEGIN(STAGE_SPHERE);
+    struct draw_cmd *cmd = dl_push(OP_CIRCLE, y - radius, y + radius + 1, color);
+    if (cmd != NULL){
+        cmd->a = x;
+        cmd->b = y;
+        cmd->c = radius;
+    }
+    PROBE_END(STAGE_SPHERE);
+}
+void raster_circle(char *buffer, const struct draw_cmd *cmd, int y0, int y1)
+{
+    // One span per row. The half width of each row is found incrementally
+    // from the row above instead of testing every pixel: it grows down to
+    // the centre row and shrinks after it.
+    int x = cmd->a;
+    int r2 = cmd->c * cmd->c;
+    int half_width = 0;
+    for (int y = y0; y < y1; y++)
     {
-        for (j = y0; j <= y1; j++)
+        int dy = y - cmd->b;
+        while ((half_width + 1) * (half_width + 1) + dy * dy <= r2)
         {
-            if ((i - x) * (i - x) + (j - y) * (j - y) <= radius * radius)
-            {
-                plot_pixel(i, j, color);
+            half_width++;
+        }
+        while (half_width * half_width + dy * dy > r2)
+        {
+            half_width--;
+        }
+        raster_span(buffer, x - half_width, x + half_width + 1, y, cmd->color);
+    }
+}
+
+/* Font: each letter is 8x8 pixels, drawn stretched to 8x16. */
+static const uint8_t letter_matrices[][8] = {
+    // 8x8 binary matrices for each uppercase letter, with 1s indicating where to draw the letter pixels.
+    // The most significant bit is the leftmost column.
+    0x1C, 0x36, 0x63, 0x63, 0x7F, 0x63, 0x63, 0x00, // A
+    0x3E, 0x33, 0x33, 0x3E, 0x33, 0x33, 0x3E, 0x00, // B
+    0x1E, 0x33, 0x30, 0x30, 0x30, 0x33, 0x1E, 0x00, // C
+    0x3E, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3E, 0x00, // D
+    0x3F, 0x30, 0x30, 0x3C, 0x30, 0x30, 0x3F, 0x00, // E
+    0x3F, 0x30, 0x30, 0x3E, 0x30, 0x30, 0x30, 0x00, // F
+    0x1F, 0x30, 0x30, 0x33, 0x33, 0x33, 0x1F, 0x00, // G
+    0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00, // H
+    0x1C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1C, 0x00, // I
+    0x0E, 0x06, 0x06, 0x06, 0x06, 0x36, 0x1C, 0x00, // J
+    0x33, 0x36, 0x3C, 0x38, 0x3C, 0x36, 0x33, 0x00, // K
+    0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x3F, 0x00, // L
+    0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00, // M
+    0x33, 0x33, 0x3B, 0x3F, 0x37, 0x33, 0x33, 0x00, // N
+    0x1E, 0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x00, // O
+    // P
+    0x3E, 0x33, 0x33, 0x3E, 0x30, 0x30, 0x30, 0x00,
+    // Q
+    0x1E, 0x33, 0x33, 0x33, 0x37, 0x36, 0x1D, 0x00,
+    // R
+    0x3E, 0x33, 0x33, 0x3E, 0x3C, 0x36, 0x33, 0x00,
+    // S
+    0x1F, 0x30, 0x30, 0x1E, 0x03, 0x03, 0x3E, 0x00,
+    // T
+    0x7F, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x00,
+    // U
+    0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x00,
+    // V
+    0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00,
+    // W
+    0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00,
+    // X
+    0x63, 0x36, 0x1C, 0x08, 0x1C, 0x36, 0x63, 0x00,
+    // Y
+    0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x0C, 0x00,
+    // Z
+    0x3F, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x7F, 0x00, 
+    // _
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0XFF
+    
+};
+
+/* Glyph atlas built once from letter_matrices: every glyph row is stored as
+ * the runs of set pixels, so text is written a run at a time instead of
+ * testing each bit. glyph_index maps a character (either case) to its glyph,
+ * glyph 0 is blank. */
+#define NUM_GLYPHS 28
+#define MAX_GLYPH_RUNS 4
+
+struct glyph_row {
+    uint8_t num_runs;
+    uint8_t start[MAX_GLYPH_RUNS];
+    uint8_t length[MAX_GLYPH_RUNS];
+};
+
+struct glyph_row glyph_atlas[NUM_GLYPHS][8];
+uint8_t glyph_index[256];
+int glyph_atlas_ready = FALSE;
+
+void build_glyph_atlas(){
+    for (int c = 0; c < 26; c++){
+        glyph_index['A' + c] = c + 1;
+        glyph_index['a' + c] = c + 1;
+    }
+    glyph_index['_'] = 27;
+
+    for (int g = 1; g < NUM_GLYPHS; g++){
+        for (int i = 0; i < 8; i++){
+            uint8_t bits = letter_matrices[g - 1][i];
+            struct glyph_row *row = &glyph_atlas[g][i];
+            row->num_runs = 0;
+            int j = 0;
+            while (j < 8){
+                if (bits & (1 << (7 - j))){
+                    int run_start = j;
+                    while (j < 8 && (bits & (1 << (7 - j))))
+                        j++;
+                    row->start[row->num_runs] = run_start;
+                    row->length[row->num_runs] = j - run_start;
+                    row->num_runs++;
+                } else {
+                    j++;
+                }
             }
         }
     }
+    glyph_atlas_ready = TRUE;
 }
 
-void draw_letter_helper(int x, int y, short int color, const uint32_t letter_matrix[8]);
+void draw_word(int word_len, char *word, int x, int y, int color){
+    /**
+     * @brief Draws a string on the VGA screen, 10 pixels per character.
+     *
+     * The string is copied into the display list and drawn as one glyph run:
+     * every pixel row writes the runs of all characters before moving to the
+     * next row. Characters without a glyph (such as spaces) are skipped.
+     */
+    if (!glyph_atlas_ready)
+        build_glyph_atlas();
+    PROBE_BEGIN(STAGE_TEXT);
+    word_len = MIN(word_len, DL_TEXT_SIZE);
+    if (display_list->text_used + word_len > DL_TEXT_SIZE)
+        display_list_flush();
+    struct draw_cmd *cmd = dl_push(OP_GLYPHS, y, y + LETTER_HEIGHT, color);
+    if (cmd != NULL){
+        char *text = display_list->text + display_list->text_used;
+        memcpy(text, word, word_len);
+        display_list->text_used += word_len;
+        cmd->a = x;
+        cmd->b = y;
+        cmd->c = word_len;
+        cmd->data = text;
+    }
+    PROBE_END(STAGE_TEXT);
+}
+static inline __attribute__((always_inline))
+void glyph_rows(char *buffer, const struct draw_cmd *cmd, int y0, int y1, int clipped){
+    // Copies of the command fields: the pixel stores could alias them
+    const char *text = cmd->data;
+    int x0 = cmd->a, length = cmd->c;
+    uint16_t color = cmd->color;
+    for (int y = y0; y < y1; y++){
+        uint16_t *row = (uint16_t *)(buffer + (y << 10)) + x0;
+        int r = (y - cmd->b) >> 1;
+        for (int i = 0; i < length; i++, row += LETTER_WIDTH){
+            const struct glyph_row *g = &glyph_atlas[glyph_index[(unsigned char)text[i]]][r];
+            for (int k = 0; k < g->num_runs; k++){
+                int start = g->start[k];
+                int end = start + g->length[k];
+                if (clipped){
+                    int x = x0 + i * LETTER_WIDTH;
+                    start = MAX(start, -x);
+                    end = MIN(end, RESOLUTION_X - x);
+                }
+                for (uint16_t *p = row + start; start < end; start++)
+                    *p++ = color;
+            }
+        }
+    }
+}
+void raster_glyphs(char *buffer, const struct draw_cmd *cmd, int y0, int y1){
+    // only strings running off the screen pay for clipping
+    if (cmd->a < 0 || cmd->a + cmd->c * LETTER_WIDTH > RESOLUTION_X)
+        glyph_rows(buffer, cmd, y0, y1, TRUE);
+    else
+        glyph_rows(buffer, cmd, y0, y1, FALSE);
+}
 
 void draw_letter(char letter, int x, int y, short int color){
     /**
@@ -211,99 +1373,130 @@ void draw_letter(char letter, int x, int y, short int color){
      * Each letter will be written in uppercase for simplicity
      * Each letter is 8x8 pixels.
      */
-    letter = toupper(letter);
-    static const uint32_t letter_matrices[][8] = {
-        // Define 8x8 binary matrices for each uppercase letter here, with 1s indicating where to draw the letter pixels.
-        // Each matrix should have dimensions [8] and represent a single uppercase letter.
-        0x1C, 0x36, 0x63, 0x63, 0x7F, 0x63, 0x63, 0x00, // A
-        0x3E, 0x33, 0x33, 0x3E, 0x33, 0x33, 0x3E, 0x00, // B
-        0x1E, 0x33, 0x30, 0x30, 0x30, 0x33, 0x1E, 0x00, // C
-        0x3E, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3E, 0x00, // D
-        0x3F, 0x30, 0x30, 0x3C, 0x30, 0x30, 0x3F, 0x00, // E
-        0x3F, 0x30, 0x30, 0x3E, 0x30, 0x30, 0x30, 0x00, // F
-        0x1F, 0x30, 0x30, 0x33, 0x33, 0x33, 0x1F, 0x00, // G
-        0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00, // H
-        0x1C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1C, 0x00, // I
-        0x0E, 0x06, 0x06, 0x06, 0x06, 0x36, 0x1C, 0x00, // J
-        0x33, 0x36, 0x3C, 0x38, 0x3C, 0x36, 0x33, 0x00, // K
-        0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x3F, 0x00, // L
-        0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00, // M
-        0x33, 0x33, 0x3B, 0x3F, 0x37, 0x33, 0x33, 0x00, // N
-        0x1E, 0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x00, // O
-        // P
-        0x3E, 0x33, 0x33, 0x3E, 0x30, 0x30, 0x30, 0x00,
-        // Q
-        0x1E, 0x33, 0x33, 0x33, 0x37, 0x36, 0x1D, 0x00,
-        // R
-        0x3E, 0x33, 0x33, 0x3E, 0x3C, 0x36, 0x33, 0x00,
-        // S
-        0x1F, 0x30, 0x30, 0x1E, 0x03, 0x03, 0x3E, 0x00,
-        // T
-        0x7F, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x00,
-        // U
-        0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x00,
-        // V
-        0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00,
-        // W
-        0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00,
-        // X
-        0x63, 0x36, 0x1C, 0x08, 0x1C, 0x36, 0x63, 0x00,
-        // Y
-        0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x0C, 0x00,
-        // Z
-        0x3F, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x7F, 0x00, 
-        // _
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0XFF
-        
-    };
-    
-    if (letter >= 'A' && letter <= 'Z') {
-        int letter_index = letter - 'A';
-        draw_letter_helper(x, y, color, letter_matrices[letter_index]);
-    } else if (letter == '_'){
-        draw_letter_helper(x, y, color, letter_matrices[26]);
-    }
+    draw_word(1, &letter, x, y, color);
 }
 
-void draw_letter_helper(int x, int y, short int color, const uint32_t letter_matrix[8]) {
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            if (letter_matrix[i] & (1 << (7-j))) {
-                plot_pixel(x + j, y + 2* i, color);
-                
-                plot_pixel(x + j, y + 2* i + 1, color);
-            }
+/* Text layer. The game's text goes to the 80x60 character buffer, which the
+ * VGA controller overlays on the pixel buffer: one byte per character, white
+ * on a transparent background, shown in every frame without being drawn into
+ * the pixel buffers. text_cells mirrors the buffer so that only cells that
+ * change are written. */
+#define TEXT_COLS 80
+#define TEXT_ROWS 60
+
+char text_cells[TEXT_ROWS][TEXT_COLS];      // 0 until the cell is first written
+
+void text_put(int col, int row, const char *text, int len){
+    // Write len characters from col, clipped to the row
+    if (row < 0 || row >= TEXT_ROWS)
+        return;
+    char *cells = MEM_ADDR(FPGA_CHAR_BASE + (row << 7));
+    for (int i = 0; i < len; i++, col++){
+        if (col < 0 || col >= TEXT_COLS)
+            continue;
+        if (text_cells[row][col] != text[i]){
+            text_cells[row][col] = text[i];
+            cells[col] = text[i];
         }
     }
-   
 }
 
+void text_clear(){
+    // Blank every cell, not only those the mirror knows of: at startup the
+    // buffer still holds whatever the last program left in it
+    char blank[TEXT_COLS];
+    memset(text_cells, 0, sizeof(text_cells));
+    memset(blank, ' ', sizeof(blank));
+    for (int row = 0; row < TEXT_ROWS; row++)
+        text_put(0, row, blank, TEXT_COLS);
+}
 
-void draw_word(int word_len, char *word, int x, int y, int color){
-    for (int i = 0; i < word_len; i++){
-        if (word[i] != ' ')
-            draw_letter(word[i], x + 10*i, y, color);
+void text_message(int row, const char *text){
+    text_put(MESSAGE_COL, row, text, strlen(text));
+}
+
+/* State of one round. Letters are kept as 26-bit masks (bit 0 is 'a'), so a
+ * guess, a repeat check and the win check are each a few bit operations. The
+ * struct holds no pointers to heap memory and no globals are involved, so any
+ * number of rounds can be played side by side. */
+struct round {
+    const char *word;
+    int length;
+    int health;
+    uint32_t letters;       // letters that appear in the word
+    uint32_t guessed;       // every letter guessed so far
+    uint32_t revealed;      // guessed letters that are in the word
+    int num_misses;
+    char misses[26];        // wrong guesses in the order they were made
+};
+
+enum guess_result { GUESS_INVALID, GUESS_REPEAT, GUESS_HIT, GUESS_MISS };
+
+uint32_t letter_bit(char letter){
+    return (letter >= 'a' && letter <= 'z') ? 1u << (letter - 'a') : 0;
+}
+
+void round_start(struct round *round, const char *word){
+    round->word = word;
+    round->length = strlen(word);
+    round->health = MAX_HEALTH;
+    round->letters = 0;
+    for (int i = 0; i < round->length; i++)
+        round->letters |= letter_bit(word[i]);
+    round->guessed = 0;
+    round->revealed = 0;
+    round->num_misses = 0;
+}
+
+enum guess_result round_guess(struct round *round, char letter){
+    uint32_t bit = letter_bit(letter);
+    if (bit == 0)
+        return GUESS_INVALID;
+    if (round->guessed & bit)
+        return GUESS_REPEAT;
+    round->guessed |= bit;
+    if (round->letters & bit){
+        round->revealed |= bit;
+        return GUESS_HIT;
     }
+    round->misses[round->num_misses++] = letter;
+    round->health--;
+    return GUESS_MISS;
 }
-void draw_current_word(char * word, int color){
-    for (int i = 0 ; i < strlen(word); i++){
-        if (letter_states[i] == 1){
-            draw_letter(word[i], 20 + i * 10, 70, color);
-        } else {
-            draw_letter('_', 20 + i*10, 70, color);
-        }
+
+int round_won(const struct round *round){
+    return round->revealed == round->letters;
+}
+
+int round_lost(const struct round *round){
+    return round->health <= 0;
+}
+
+void draw_current_word(const struct round *round, uint32_t shown, int reveal){
+    // Letters in the shown mask are written, the others as '_', or in
+    // uppercase with reveal set (the overlay has a single colour)
+    char line[2 * TEXT_COLS];
+    int n = 0;
+    for (int i = 0 ; i < round->length; i++){
+        char c = round->word[i];
+        if (!(shown & letter_bit(c)))
+            c = reveal ? toupper((unsigned char)c) : '_';
+        line[n++] = c;
+        line[n++] = ' ';
     }
+    text_put(TEXT_COL, WORD_ROW, line, n);
 }
 
-void draw_current_guesses(){
-    int length = strlen(wrong_guesses);
-    for (int i = 0; i < length; i++){
-    
-        draw_letter(wrong_guesses[i], 20 + i * 10, 100, RED);
+void draw_current_guesses(const struct round *round){
+    char line[2 * 26];
+    for (int i = 0; i < round->num_misses; i++){
+        line[2 * i] = round->misses[i];
+        line[2 * i + 1] = ' ';
     }
+    text_put(TEXT_COL, GUESSES_ROW, line, 2 * round->num_misses);
 }
 
-void draw_current_snowman(int health) {
+void render_snowman(int health) {
     // Draw snowman based on health
     int mid_x = RESOLUTION_X/2 + 100;
     if (health == 5) {
@@ -356,284 +1549,1429 @@ void draw_current_snowman(int health) {
     }
 }
 
-void draw_transition_animation(int health, char* word){
-    volatile int* pixel_ctrl_ptr = (int *)0xFF203020;
-    int mid_x = RESOLUTION_X/2 + 100;
-    int dynamic_head_radius = HEAD_RADIUS, dynamic_body_radius = BODY_RADIUS, dynamic_feet_radius = FEET_RADIUS;
-    int dynamic_arm_height = HEAD_RADIUS + 5 + BODY_RADIUS + 5, dynamic_nose_height = HEAD_RADIUS + 5;
-    if (health == 4){
-        // make arms fall
-        int gravity = 1;
-        while (dynamic_arm_height < 220){
-            dynamic_arm_height+=gravity;
-            gravity++;
-            clear_snowman();
-
-            draw_sphere(mid_x , 0+HEAD_RADIUS + 5, HEAD_RADIUS, WHITE);     // head 
-            draw_sphere(mid_x , 0+HEAD_RADIUS + 5 + BODY_RADIUS + 5, BODY_RADIUS, WHITE);       // middle
-            draw_sphere(mid_x , 0+HEAD_RADIUS + 5 + BODY_RADIUS + 5 + FEET_RADIUS + 5, FEET_RADIUS, WHITE);     // bottom
-
-            draw_line(mid_x + BODY_RADIUS, dynamic_arm_height, mid_x + BODY_RADIUS + ARM_LENGTH_X, dynamic_arm_height + ARM_LENGTH_Y, GREEN); // right arm
-            draw_line(mid_x - BODY_RADIUS, dynamic_arm_height, mid_x - BODY_RADIUS - ARM_LENGTH_X, dynamic_arm_height + ARM_LENGTH_Y, GREEN); // left arm
-
-            draw_line(mid_x, HEAD_RADIUS + 5, mid_x - ARM_LENGTH_X, HEAD_RADIUS + 5 - ARM_LENGTH_Y, ORANGE);    // NOSE
-            draw_line(mid_x - ARM_LENGTH_X, HEAD_RADIUS + 5 - ARM_LENGTH_Y, mid_x, HEAD_RADIUS + 5 - ARM_LENGTH_Y, ORANGE);
-            wait_for_vsync();
-            pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
-        }
-    }
-    else if (health == 3){
-        // make face fall off
-        
-        int gravity = 1;
-        while(dynamic_nose_height < 220){
-            dynamic_nose_height+=gravity;
-            gravity++;
+/* Snowman sprites. Each health state is rasterized once, then copied out of
+ * the pixel buffer into a compact cache covering the snowman area. Only the
+ * rows holding pixels are stored; the rest of the area is black. */
+struct sprite {
+    int y0, y1;             // rows y0 <= y < y1 are stored
+    uint16_t *pixels;       // (y1 - y0) rows of SNOWMAN_AREA_WIDTH pixels
+};
+
+struct sprite snowman_sprites[6];
+
+void capture_sprite(struct sprite *sprite){
+    display_list_finish();
+    char *buffer = back_buffer.pixels;
+    int y0 = RESOLUTION_Y, y1 = 0;
+    for (int y = 0; y < RESOLUTION_Y; y++){
+        uint16_t *row = (uint16_t *)(buffer + (y << 10)) + SNOWMAN_AREA_X;
+        for (int x = 0; x < SNOWMAN_AREA_WIDTH; x++){
+            if (row[x] != 0){
+                if (y < y0) y0 = y;
+                y1 = y + 1;
+                break;
+            }
+        }
+    }
+    if (y1 < y0)
+        y0 = y1 = 0;
+
+    sprite->pixels = malloc(((y1 - y0) * SNOWMAN_AREA_WIDTH + 1) * sizeof(uint16_t));
+    if (sprite->pixels == NULL)
+        return;
+    for (int y = y0; y < y1; y++){
+        memcpy(sprite->pixels + (y - y0) * SNOWMAN_AREA_WIDTH,
+               (uint16_t *)(buffer + (y << 10)) + SNOWMAN_AREA_X,
+               SNOWMAN_AREA_WIDTH * sizeof(uint16_t));
+    }
+    sprite->y0 = y0;
+    sprite->y1 = y1;
+}
 
-            clear_snowman();
-            draw_sphere(mid_x , 0+HEAD_RADIUS + 5, HEAD_RADIUS, WHITE);     // head 
-            draw_sphere(mid_x , 0+HEAD_RADIUS + 5 + BODY_RADIUS + 5, BODY_RADIUS, WHITE);       // middle
-            draw_sphere(mid_x , 0+HEAD_RADIUS + 5 + BODY_RADIUS + 5 + FEET_RADIUS + 5, FEET_RADIUS, WHITE);     // bottom
+void blit_sprite_rect(const struct sprite *sprite, int x0, int y0, int x1, int y1){
+    // Copy x0 <= x < x1, y0 <= y < y1 of the snowman area from the sprite,
+    // black in the rows it doesn't store
+    x0 = MAX(x0, SNOWMAN_AREA_X);
+    x1 = MIN(x1, RESOLUTION_X);
+    if (x0 >= x1)
+        return;
+    fill_rect(x0, y0, x1, MIN(y1, sprite->y0), 0x0000);
+    struct draw_cmd *cmd = dl_push(OP_SPRITE, MAX(y0, sprite->y0), MIN(y1, sprite->y1), 0);
+    if (cmd != NULL){
+        cmd->a = x0;
+        cmd->c = x1;
+        cmd->data = sprite;
+    }
+    fill_rect(x0, MAX(y0, sprite->y1), x1, y1, 0x0000);
+}
 
-            draw_line(mid_x, dynamic_nose_height, mid_x - ARM_LENGTH_X, dynamic_nose_height - ARM_LENGTH_Y, ORANGE);    // NOSE
-            draw_line(mid_x - ARM_LENGTH_X, dynamic_nose_height - ARM_LENGTH_Y, mid_x, dynamic_nose_height - ARM_LENGTH_Y, ORANGE);
-            wait_for_vsync();
-            pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
+void blit_sprite(const struct sprite *sprite){
+    blit_sprite_rect(sprite, SNOWMAN_AREA_X, 0, RESOLUTION_X, RESOLUTION_Y);
+}
 
-        }
+void raster_sprite(char *buffer, const struct draw_cmd *cmd, int y0, int y1){
+    const struct sprite *sprite = cmd->data;
+    const uint16_t *pixels = sprite->pixels + (cmd->a - SNOWMAN_AREA_X);
+    for (int y = y0; y < y1; y++){
+        memcpy((uint16_t *)(buffer + (y << 10)) + cmd->a,
+               pixels + (y - sprite->y0) * SNOWMAN_AREA_WIDTH,
+               (cmd->c - cmd->a) * sizeof(uint16_t));
     }
-    else if (health == 2){
-        while(dynamic_head_radius > 0){
-            dynamic_head_radius--;
-            clear_snowman();
-            draw_sphere(mid_x, 0+HEAD_RADIUS + 5, dynamic_head_radius, WHITE);
-            draw_sphere(mid_x, 0+HEAD_RADIUS + BODY_RADIUS + 5, BODY_RADIUS, WHITE);
-            draw_sphere(mid_x, 0+HEAD_RADIUS + BODY_RADIUS + 5 + FEET_RADIUS + 5, FEET_RADIUS, WHITE);
+}
 
-            wait_for_vsync();
-            pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
+void raster_points(char *buffer, const struct draw_cmd *cmd, int y0, int y1){
+    const uint32_t *points = cmd->data;
+    const uint16_t *colors = (const uint16_t *)(points + cmd->c);
+    // first point in row y0
+    int lo = 0, hi = cmd->c;
+    while (lo < hi){
+        int mid = (lo + hi) / 2;
+        if ((int)(points[mid] >> 16) < y0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    uint32_t end = (uint32_t)y1 << 16;
+    for (int i = lo; i < cmd->c && points[i] < end; i++){
+        uint32_t p = points[i];
+        *(uint16_t *)(buffer + ((p >> 16) << 10) + ((p & 0xFFFF) << 1)) = colors[i];
+    }
+}
+
+void compose_row(uint16_t *dst, int offset, int n){
+    // Each pixel from the topmost layer that isn't its key there, in one
+    // pass: 8 pixels at a time with NEON, or 4 at a time in a 64-bit word
+    // copies of the keys: the pixel stores could alias them
+    const uint16_t *src[NUM_LAYERS];
+    uint16_t keys[NUM_LAYERS];
+    for (int l = 0; l < NUM_LAYERS; l++){
+        src[l] = layer_pixels[l] + offset;
+        keys[l] = layers[l].key;
+    }
+    int i = 0;
+#ifdef __ARM_NEON
+    uint16x8_t wide_keys[NUM_LAYERS];
+    for (int l = 0; l < NUM_LAYERS; l++)
+        wide_keys[l] = vdupq_n_u16(keys[l]);
+    for (; i + 8 <= n; i += 8){
+        uint16x8_t p = vld1q_u16(src[LAYER_BACKGROUND] + i);
+        for (int l = LAYER_BACKGROUND + 1; l < NUM_LAYERS; l++){
+            uint16x8_t s = vld1q_u16(src[l] + i);
+            p = vbslq_u16(vceqq_u16(s, wide_keys[l]), p, s);
+        }
+        vst1q_u16(dst + i, p);
+    }
+#else
+    const uint64_t low = 0x7FFF7FFF7FFF7FFFull;
+    uint64_t wide_keys[NUM_LAYERS];
+    for (int l = 0; l < NUM_LAYERS; l++)
+        wide_keys[l] = keys[l] * 0x0001000100010001ull;
+    for (; i + 4 <= n; i += 4){
+        uint64_t p, s;
+        memcpy(&p, src[LAYER_BACKGROUND] + i, sizeof(p));
+        for (int l = LAYER_BACKGROUND + 1; l < NUM_LAYERS; l++){
+            memcpy(&s, src[l] + i, sizeof(s));
+            uint64_t x = s ^ wide_keys[l];
+            uint64_t differs = ((x & low) + low) | x;       // top bit of each pixel set if it isn't the key
+            uint64_t mask = ((differs & ~low) >> 15) * 0xFFFF;
+            p = (s & mask) | (p & ~mask);
         }
-    } else if (health == 1){
-        while(dynamic_body_radius > 0){
-            dynamic_body_radius--;
-            clear_snowman();
-            draw_sphere(mid_x, 0+HEAD_RADIUS + BODY_RADIUS + 5, dynamic_body_radius, WHITE);
-            draw_sphere(mid_x, 0+HEAD_RADIUS + BODY_RADIUS + 5 + FEET_RADIUS + 5, FEET_RADIUS, WHITE);
+        memcpy(dst + i, &p, sizeof(p));
+    }
+#endif
+    for (; i < n; i++){
+        uint16_t p = src[LAYER_BACKGROUND][i];
+        for (int l = LAYER_BACKGROUND + 1; l < NUM_LAYERS; l++)
+            p = (src[l][i] == keys[l]) ? p : src[l][i];
+        dst[i] = p;
+    }
+}
+
+void raster_compose(char *buffer, const struct draw_cmd *cmd, int y0, int y1){
+    for (int y = y0; y < y1; y++)
+        compose_row((uint16_t *)(buffer + (y << 10)) + cmd->a, (y << 9) + cmd->a, cmd->c - cmd->a);
+}
 
-            wait_for_vsync();
-            pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
+void display_list_execute(struct display_list *list){
+    if (list->count == 0)
+        return;
+    PROBE_BEGIN(STAGE_RASTER);
+    char *buffer = target_pixels(list->target);
+    int top = RESOLUTION_Y, bottom = 0;
+    for (int i = 0; i < list->count; i++){
+        top = MIN(top, list->cmds[i].y0);
+        bottom = MAX(bottom, list->cmds[i].y1);
+    }
+    for (int band = top - top % DL_BAND_ROWS; band < bottom; band += DL_BAND_ROWS){
+        for (int i = 0; i < list->count; i++){
+            const struct draw_cmd *cmd = &list->cmds[i];
+            int y0 = MAX(cmd->y0, band);
+            int y1 = MIN(cmd->y1, band + DL_BAND_ROWS);
+            if (y0 >= y1)
+                continue;
+            switch (cmd->op){
+            case OP_RECT:   raster_rect(buffer, cmd, y0, y1); break;
+            case OP_CIRCLE: raster_circle(buffer, cmd, y0, y1); break;
+            case OP_LINE:   raster_line(buffer, cmd, y0, y1); break;
+            case OP_GLYPHS: raster_glyphs(buffer, cmd, y0, y1); break;
+            case OP_SPRITE: raster_sprite(buffer, cmd, y0, y1); break;
+            case OP_POINTS: raster_points(buffer, cmd, y0, y1); break;
+            case OP_COMPOSE: raster_compose(buffer, cmd, y0, y1); break;
+            }
         }
-    } else if (health == 0){
-        while(dynamic_feet_radius > 0){
-            dynamic_feet_radius--;
-            clear_snowman();
-            draw_sphere(mid_x, 0+HEAD_RADIUS + BODY_RADIUS + 5 + FEET_RADIUS + 5, dynamic_feet_radius, WHITE);
+    }
+    list->count = 0;
+    list->text_used = 0;
+    list->points_used = 0;
+    PROBE_END(STAGE_RASTER);
+}
+
+#ifdef DUAL_CORE
+/* Dual-core mode. Core 0 runs input and the game and records display lists;
+ * core 1 rasterizes them and flips the pixel buffers. The lists are handed
+ * over through a lock-free triple buffer: core 0 records into one list,
+ * core 1 draws another, and the third is in mailbox_slot waiting to be
+ * taken (MAILBOX_FRESH) or already taken. Core 0 never overwrites a list
+ * core 1 hasn't taken, because the game draws each buffer incrementally and
+ * every list has to be drawn. So core 0 runs at most one frame ahead: input
+ * is handled as soon as in single-core mode, while the game logic of a frame
+ * overlaps the rasterization of the one before it. */
+#define MAILBOX_FRESH 4
+
+#ifdef HOST_SIM
+#define CPU_RELAX() sim_cpu_relax()
+#else
+#define CPU_RELAX() __asm__ volatile("nop")
+#define RSTMGR_MPUMODRST    0xFFD05010      // bit 1 holds CPU1 in reset
+#define SYSMGR_CPU1_START   0xFFD080C4      // where the boot ROM sends CPU1
+#define RENDER_CORE_STACK   16384
+#endif
+
+volatile int mailbox_slot = 1;              // core 0 starts on list 0, core 1 on list 2
+volatile unsigned int frames_published, frames_rendered;
+int render_core_running;
+
+void frame_publish(int present){
+    display_list->present = present;
+    while (mailbox_slot & MAILBOX_FRESH)
+        CPU_RELAX();        // core 1 hasn't taken the previous list yet
+    int old = __atomic_exchange_n(&mailbox_slot, (int)(display_list - display_lists) | MAILBOX_FRESH, __ATOMIC_ACQ_REL);
+    __sync_fetch_and_add(&frames_published, 1);
+    display_list = &display_lists[old & 3];
+}
+
+void render_core_main(){
+    int slot = 2;
+    while (1){
+        while (!(mailbox_slot & MAILBOX_FRESH))
+            CPU_RELAX();
+        slot = __atomic_exchange_n(&mailbox_slot, slot, __ATOMIC_ACQ_REL) & 3;
+        struct display_list *list = &display_lists[slot];
+        display_list_execute(list);
+        if (list->present)
+            present(list->target);
+        __sync_fetch_and_add(&frames_rendered, 1);
+    }
+}
+
+#ifndef HOST_SIM
+char render_core_stack[RENDER_CORE_STACK] __attribute__((aligned(8)));
+
+void __attribute__((naked)) render_core_entry(){
+    // Core 1 comes out of reset with IRQs masked. Join the SMP coherency
+    // domain (ACTLR.SMP), set up a stack and run the renderer.
+    __asm__ volatile(
+        "mrc p15, 0, r0, c1, c0, 1\n"
+        "orr r0, r0, #0x40\n"
+        "mcr p15, 0, r0, c1, c0, 1\n"
+        "ldr sp, =render_core_stack + %c0\n"
+        "b render_core_main\n"
+        : : "i"(RENDER_CORE_STACK));
+}
+#endif
+
+void start_render_core(){
+    render_core_running = TRUE;
+#ifdef HOST_SIM
+    sim_start_core(1, render_core_main);
+#else
+    IO_WRITE(SYSMGR_CPU1_START, (int)render_core_entry);
+    IO_WRITE(RSTMGR_MPUMODRST, IO_READ(RSTMGR_MPUMODRST) & ~2);
+#endif
+}
+#endif
+
+void display_list_flush(){
+    // Rasterize what has been recorded, or hand it to the render core
+#ifdef DUAL_CORE
+    if (render_core_running){
+        if (display_list->count != 0)
+            frame_publish(FALSE);
+        return;
+    }
+#endif
+    display_list_execute(display_list);
+}
+
+void display_list_finish(){
+    // Flush, and wait until the pixels are in the buffer
+    display_list_flush();
+#ifdef DUAL_CORE
+    while (render_core_running && frames_rendered != frames_published)
+        CPU_RELAX();
+#endif
+}
+
+void show_frame(){
+    // Show the frame drawn so far and move on to the next buffer. The render
+    // core presents in the same order, so the next one is free by the time
+    // it is drawn.
+#ifdef DUAL_CORE
+    if (render_core_running){
+        // the list may still hold a layer's commands; those go first, and
+        // the list that presents names the buffer even if it is empty
+        if (display_list->count != 0 && display_list->target != back_buffer.index)
+            frame_publish(FALSE);
+        display_list->target = back_buffer.index;
+        frame_publish(TRUE);
+    } else
+#endif
+    {
+        display_list_flush();
+        present(back_buffer.index);
+    }
+    select_target((back_buffer.index + 1) % NUM_PIXEL_BUFFERS);
+}
+
+void present_init(){
+    // Clear every buffer, show the first and draw into the second
+    for (int b = 0; b < NUM_PIXEL_BUFFERS; b++){
+        select_target(b);
+        clear_screen();
+    }
+    display_list_finish();
+    present(0);
+    while (present_poll())
+        ;
+    select_target(1);
+}
 
-            wait_for_vsync();
-            pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
+void clear_all_buffers(){
+    // Clear the screen in every buffer, showing each one in turn
+    for (int b = 0; b < NUM_PIXEL_BUFFERS; b++){
+        clear_screen();
+        show_frame();
+    }
+}
+
+void draw_current_snowman(int health) {
+    if (health < 0)
+        health = 0;
+    if (health > 5)
+        health = 5;
+    PROBE_BEGIN(STAGE_SNOWMAN);
+    struct sprite *sprite = &snowman_sprites[health];
+    if (sprite->pixels != NULL){
+        blit_sprite(sprite);
+    } else {
+        render_snowman(health);
+        capture_sprite(sprite);
+    }
+    PROBE_END(STAGE_SNOWMAN);
+}
+
+/* Composition. The game draws into the layers and calls compose() once per
+ * frame, which records an OP_COMPOSE command for each run of rows whose
+ * changed columns are the same, covering everything any layer changed since
+ * the back buffer was last composed. Composing copies the background and
+ * merges the layers above it one row at a time; rows no layer touched cost
+ * nothing. */
+struct rect effects_drawn;      // the effects layer is transparent outside it
+
+int select_layer(int layer){
+    // Draw into a layer from here on. Returns the pixel buffer to select after.
+    int buffer = back_buffer.index;
+    select_target(NUM_PIXEL_BUFFERS + layer);
+    return buffer;
+}
+
+void layer_damage(int layer, int x0, int y0, int x1, int y1){
+    damage_add(layers[layer].damage, x0, y0, x1, y1);
+}
+
+void compose(){
+    int16_t span_x0[RESOLUTION_Y], span_x1[RESOLUTION_Y];
+    for (int y = 0; y < RESOLUTION_Y; y++){
+        span_x0[y] = RESOLUTION_X;
+        span_x1[y] = 0;
+    }
+    for (int l = 0; l < NUM_LAYERS; l++){
+        struct damage_list *list = &layers[l].damage[back_buffer.index];
+        for (int i = 0; i < list->count; i++){
+            const struct rect *r = &list->rects[i];
+            for (int y = r->y0; y < r->y1; y++){
+                span_x0[y] = MIN(span_x0[y], r->x0);
+                span_x1[y] = MAX(span_x1[y], r->x1);
+            }
         }
+        list->count = 0;
     }
-    // Clear previous animation frames 
-    draw_current_snowman(health);
-    draw_current_word(word, WHITE);
-    draw_current_guesses();
-    wait_for_vsync();
-    pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
+    int y = 0;
+    while (y < RESOLUTION_Y){
+        int y0 = y, x0 = span_x0[y], x1 = span_x1[y];
+        while (++y < RESOLUTION_Y && span_x0[y] == x0 && span_x1[y] == x1)
+            ;
+        if (x0 >= x1)
+            continue;
+        struct draw_cmd *cmd = dl_push(OP_COMPOSE, y0, y, 0);
+        if (cmd != NULL){
+            cmd->a = x0;
+            cmd->c = x1;
+        }
+    }
+}
+
+void show_snowman(int health){
+    // Put the snowman for this health in its layer
+    int buffer = select_layer(LAYER_SNOWMAN);
     draw_current_snowman(health);
-    draw_current_word(word, WHITE);
-    draw_current_guesses();
-    wait_for_vsync();
-    pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
+    select_target(buffer);
+    layer_damage(LAYER_SNOWMAN, SNOWMAN_AREA_X, 0, RESOLUTION_X, RESOLUTION_Y);
+}
+
+int effects_begin(){
+    // Erase the effects layer and draw into it; whatever is drawn has to grow
+    // effects_drawn to cover it. Returns the pixel buffer for effects_end.
+    int buffer = select_layer(LAYER_EFFECTS);
+    struct rect *r = &effects_drawn;
+    fill_rect(r->x0, r->y0, r->x1, r->y1, layers[LAYER_EFFECTS].key);
+    layer_damage(LAYER_EFFECTS, r->x0, r->y0, r->x1, r->y1);
+    *r = (struct rect){RESOLUTION_X, RESOLUTION_Y, 0, 0};
+    return buffer;
+}
+
+void effects_end(int buffer){
+    select_target(buffer);
+    layer_damage(LAYER_EFFECTS, effects_drawn.x0, effects_drawn.y0, effects_drawn.x1, effects_drawn.y1);
+}
+
+void layers_init(){
+    int buffer = select_layer(LAYER_BACKGROUND);
+    clear_screen();
+    select_target(buffer);
+}
+
+void layers_reset(int health){
+    // Start a round: no effects, a fresh snowman, and every layer composed
+    // into every buffer
+    effects_end(effects_begin());
+    show_snowman(health);
+    layer_damage(LAYER_BACKGROUND, 0, 0, RESOLUTION_X, RESOLUTION_Y);
+}
+
+/* Particles: drips and splashes while the snowman melts, snowfall on the win
+ * screen. The pool is a structure of arrays with a fixed capacity, so a
+ * spawn is an append and a dead particle is replaced by the last one;
+ * nothing is allocated. Positions and velocities are 24.8 fixed point and a
+ * step is integer adds only, four particles at a time with NEON. Steps are a
+ * fixed 1/60 s of the animation clock, so the motion doesn't depend on the
+ * frame rate. All particles are plotted by one OP_POINTS command, bucketed
+ * by row. */
+#define MAX_PARTICLES DL_MAX_POINTS
+#define PARTICLE_SHIFT 8
+#define PARTICLE_ONE (1 << PARTICLE_SHIFT)
+#define PARTICLE_STEP_TICKS (CLOCK_TICKS_PER_MS * 50 / 3)     // 1/60 s
+#define PARTICLE_MAX_STEPS 8        // caught up after a slow frame, the rest is skipped
+#define SPLASH_PARTICLES 4
+#define SNOW_PER_STEP 4
+
+enum particle_flags { PARTICLE_SPLASHES = 1 };     // splashes when it hits the ground
+
+struct particles {
+    int count;
+    struct rect clip;           // particles leaving it are retired, its bottom is the ground
+    uint32_t last_step;         // clock_ticks() at the last step
+    uint32_t random;
+    int32_t x[MAX_PARTICLES];
+    int32_t y[MAX_PARTICLES];
+    int32_t vx[MAX_PARTICLES];
+    int32_t vy[MAX_PARTICLES];
+    int32_t ay[MAX_PARTICLES];
+    int32_t life[MAX_PARTICLES];    // steps left
+    uint16_t color[MAX_PARTICLES];
+    uint8_t flags[MAX_PARTICLES];
+};
+
+struct particles particles;
+
+void particles_reset(struct particles *p, int x0, int y0, int x1, int y1){
+    p->count = 0;
+    p->clip = (struct rect){x0, y0, x1, y1};
+    p->last_step = clock_ticks();
+    p->random = 0x9E3779B9u;    // its own sequence, the word choice doesn't depend on it
+}
+
+int particle_random(struct particles *p, int range){
+    // 0 <= n < range
+    uint32_t x = p->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    p->random = x;
+    return (int)(x % (uint32_t)range);
+}
+
+void particle_spawn(struct particles *p, int32_t x, int32_t y, int32_t vx, int32_t vy,
+                    int32_t ay, int life, short int color, int flags){
+    // Position in fixed point; dropped if the pool is full or it is outside the clip
+    int px = x >> PARTICLE_SHIFT, py = y >> PARTICLE_SHIFT;
+    if (p->count == MAX_PARTICLES || px < p->clip.x0 || px >= p->clip.x1 || py < p->clip.y0 || py >= p->clip.y1)
+        return;
+    int i = p->count++;
+    p->x[i] = x;
+    p->y[i] = y;
+    p->vx[i] = vx;
+    p->vy[i] = vy;
+    p->ay[i] = ay;
+    p->life[i] = life;
+    p->color[i] = color;
+    p->flags[i] = flags;
 }
 
-int convert_to_ascii(int num) {
-    // Convert number to ASCII
-    if (num == 0x1C) {
-        return 'a';
+void particles_move_scalar(struct particles *p, int first){
+    for (int i = first; i < p->count; i++){
+        p->x[i] += p->vx[i];
+        p->y[i] += p->vy[i];
+        p->vy[i] += p->ay[i];
+        p->life[i]--;
     }
-    else if (num == 0x32) {
-        return 'b';
+}
+
+void particles_move(struct particles *p){
+    int i = 0;
+#ifdef __ARM_NEON
+    const int32x4_t one = vdupq_n_s32(1);
+    for (; i + 4 <= p->count; i += 4){
+        int32x4_t vy = vld1q_s32(p->vy + i);
+        vst1q_s32(p->x + i, vaddq_s32(vld1q_s32(p->x + i), vld1q_s32(p->vx + i)));
+        vst1q_s32(p->y + i, vaddq_s32(vld1q_s32(p->y + i), vy));
+        vst1q_s32(p->vy + i, vaddq_s32(vy, vld1q_s32(p->ay + i)));
+        vst1q_s32(p->life + i, vsubq_s32(vld1q_s32(p->life + i), one));
     }
-    else if (num == 0x21) {
-        return 'c';
+#endif
+    particles_move_scalar(p, i);
+}
+
+void particles_retire(struct particles *p){
+    // Remove the particles that expired or left the clip, splashing the ones
+    // that hit the ground
+    int ground = p->clip.y1 << PARTICLE_SHIFT;
+    int i = 0;
+    while (i < p->count){
+        int px = p->x[i] >> PARTICLE_SHIFT;
+        int32_t y = p->y[i];
+        if (p->life[i] > 0 && px >= p->clip.x0 && px < p->clip.x1 && y >= (p->clip.y0 << PARTICLE_SHIFT) && y < ground){
+            i++;
+            continue;
+        }
+        if (y >= ground && (p->flags[i] & PARTICLE_SPLASHES)){
+            int32_t x = p->x[i];
+            for (int s = 0; s < SPLASH_PARTICLES; s++){
+                particle_spawn(p, x, ground - PARTICLE_ONE,
+                               particle_random(p, 2 * PARTICLE_ONE + 1) - PARTICLE_ONE,
+                               -PARTICLE_ONE - particle_random(p, PARTICLE_ONE),
+                               PARTICLE_ONE / 4, 12, p->color[i], 0);
+            }
+        }
+        int last = --p->count;
+        p->x[i] = p->x[last];
+        p->y[i] = p->y[last];
+        p->vx[i] = p->vx[last];
+        p->vy[i] = p->vy[last];
+        p->ay[i] = p->ay[last];
+        p->life[i] = p->life[last];
+        p->color[i] = p->color[last];
+        p->flags[i] = p->flags[last];
     }
-    else if (num == 0x23) {
-        return 'd';
+}
+
+void particles_step(struct particles *p){
+    particles_move(p);
+    particles_retire(p);
+}
+
+int particles_advance(struct particles *p){
+    // Run the steps due by the clock and return how many were run
+    uint32_t now = clock_ticks();
+    uint32_t steps = (now - p->last_step) / PARTICLE_STEP_TICKS;
+    if (steps > PARTICLE_MAX_STEPS){
+        steps = PARTICLE_MAX_STEPS;
+        p->last_step = now;
+    } else {
+        p->last_step += steps * PARTICLE_STEP_TICKS;
     }
-    else if (num == 0x24) {
-        return 'e';
+    PROBE_BEGIN(STAGE_PARTICLES);
+    for (uint32_t s = 0; s < steps; s++)
+        particles_step(p);
+    PROBE_END(STAGE_PARTICLES);
+    return steps;
+}
+
+void particles_snow(struct particles *p, int n){
+    // n flakes along the top of the clip, drifting down
+    int width = p->clip.x1 - p->clip.x0;
+    for (int i = 0; i < n; i++){
+        particle_spawn(p, (p->clip.x0 + particle_random(p, width)) << PARTICLE_SHIFT, p->clip.y0 << PARTICLE_SHIFT,
+                       particle_random(p, PARTICLE_ONE / 2 + 1) - PARTICLE_ONE / 4,
+                       PARTICLE_ONE / 2 + particle_random(p, 3 * PARTICLE_ONE / 4),
+                       0, 1000, WHITE, 0);
     }
-    else if (num == 0x2B) {
-        return 'f';
+}
+
+void particles_drip(struct particles *p, int x, int y, int radius, int n){
+    // n drips off the lower edge of a sphere, which is close enough to the
+    // parabola y + r - dx^2 / 2r
+    if (radius <= 0)
+        return;
+    for (int i = 0; i < n; i++){
+        int dx = particle_random(p, 2 * radius + 1) - radius;
+        int dy = radius - dx * dx / (2 * radius);
+        particle_spawn(p, (x + dx) << PARTICLE_SHIFT, (y + dy) << PARTICLE_SHIFT,
+                       0, 0, PARTICLE_ONE / 4, 1000, WATER_BLUE, PARTICLE_SPLASHES);
     }
-    else if (num == 0x34) {
-        return 'g';
+}
+
+void particles_draw(const struct particles *p, struct rect *bounds){
+    // Plot every particle and grow bounds, if given, to cover them. The
+    // points are counting-sorted by row so a band finds its rows directly.
+    int n = p->count;
+    if (n == 0)
+        return;
+    PROBE_BEGIN(STAGE_PARTICLES);
+    uint16_t rows[RESOLUTION_Y + 1] = {0};      // becomes the next slot of each row
+    int x0 = RESOLUTION_X, x1 = 0;
+    for (int i = 0; i < n; i++){
+        int x = p->x[i] >> PARTICLE_SHIFT;
+        rows[(p->y[i] >> PARTICLE_SHIFT) + 1]++;
+        x0 = MIN(x0, x);
+        x1 = MAX(x1, x + 1);
     }
-    else if (num == 0x33) {
-        return 'h';
+    int top = 0, bottom = RESOLUTION_Y;
+    while (rows[top + 1] == 0)
+        top++;
+    while (rows[bottom] == 0)
+        bottom--;
+    for (int y = 1; y <= RESOLUTION_Y; y++)
+        rows[y] += rows[y - 1];
+
+    int words = n + (n + 1) / 2;
+    if (display_list->points_used + words > DL_POINT_WORDS)
+        display_list_flush();
+    struct draw_cmd *cmd = dl_push(OP_POINTS, top, bottom, 0);
+    if (cmd != NULL){
+        uint32_t *points = display_list->points + display_list->points_used;
+        uint16_t *colors = (uint16_t *)(points + n);
+        display_list->points_used += words;
+        for (int i = 0; i < n; i++){
+            int y = p->y[i] >> PARTICLE_SHIFT;
+            int slot = rows[y]++;
+            points[slot] = (uint32_t)y << 16 | (p->x[i] >> PARTICLE_SHIFT);
+            colors[slot] = p->color[i];
+        }
+        cmd->c = n;
+        cmd->data = points;
     }
-    else if (num == 0x43) {
-        return 'i';
+    if (bounds != NULL){
+        bounds->x0 = MIN(bounds->x0, x0);
+        bounds->y0 = MIN(bounds->y0, top);
+        bounds->x1 = MAX(bounds->x1, x1);
+        bounds->y1 = MAX(bounds->y1, bottom);
     }
-    else if (num == 0x3B) {
-        return 'j';
+    PROBE_END(STAGE_PARTICLES);
+}
+
+/* Melt animations. An effect is the snowman as it stands when the miss
+ * happens, split into parts, and the tracks that move some of those parts.
+ * A track is a list of keyframes in milliseconds; between two keyframes the
+ * value follows the first one's easing curve. Progress comes from the
+ * animation clock, so a slow frame skips ahead instead of stretching the
+ * effect. The parts that stay put are rendered once into a background
+ * sprite, and each frame only the moving parts' old and new bounding boxes
+ * are restored from it and redrawn. Melting spheres shed drips, which run
+ * on until the last splash has settled. */
+enum part_shape { PART_SPHERE, PART_LINE };
+
+struct part {
+    uint8_t shape;
+    short int color;
+    int16_t x0, y0;         // line start, or the sphere's centre
+    int16_t x1, y1;         // line end
+    int16_t radius;
+};
+
+enum track_property {
+    TRACK_DROP,             // pixels the moving parts have fallen
+    TRACK_RADIUS            // radius of the moving spheres
+};
+
+enum easing { EASE_LINEAR, EASE_IN_QUAD, EASE_OUT_QUAD, EASE_HOLD };
+
+struct keyframe {
+    uint16_t ms;
+    int16_t value;
+    uint8_t easing;         // curve towards the next keyframe
+};
+
+struct track {
+    uint8_t property;
+    uint8_t num_keys;
+    const struct keyframe *keys;
+};
+
+struct melt_effect {
+    const struct part *parts;
+    uint8_t num_parts;
+    uint32_t moving;        // bit i set if the tracks move parts[i]
+    const struct track *tracks;
+    uint8_t num_tracks;
+    uint8_t drips;          // per particle step from each moving sphere
+};
+
+#define SNOWMAN_X (RESOLUTION_X/2 + 100)
+#define HEAD_Y (HEAD_RADIUS + 5)
+#define BODY_Y (HEAD_Y + BODY_RADIUS + 5)
+#define FEET_Y (BODY_Y + FEET_RADIUS + 5)
+#define LOW_BODY_Y (HEAD_RADIUS + BODY_RADIUS + 5)     // once the face is gone
+#define LOW_FEET_Y (LOW_BODY_Y + FEET_RADIUS + 5)
+
+#define SPHERE(x, y, r) {PART_SPHERE, WHITE, x, y, 0, 0, r}
+#define LINE(x0, y0, x1, y1, color) {PART_LINE, color, x0, y0, x1, y1, 0}
+#define HEAD SPHERE(SNOWMAN_X, HEAD_Y, HEAD_RADIUS)
+#define NOSE LINE(SNOWMAN_X, HEAD_Y, SNOWMAN_X - ARM_LENGTH_X, HEAD_Y - ARM_LENGTH_Y, ORANGE), \
+             LINE(SNOWMAN_X - ARM_LENGTH_X, HEAD_Y - ARM_LENGTH_Y, SNOWMAN_X, HEAD_Y - ARM_LENGTH_Y, ORANGE)
+#define ARMS LINE(SNOWMAN_X + BODY_RADIUS, BODY_Y, SNOWMAN_X + BODY_RADIUS + ARM_LENGTH_X, BODY_Y + ARM_LENGTH_Y, GREEN), \
+             LINE(SNOWMAN_X - BODY_RADIUS, BODY_Y, SNOWMAN_X - BODY_RADIUS - ARM_LENGTH_X, BODY_Y + ARM_LENGTH_Y, GREEN)
+
+static const struct part arms_parts[] = {
+    HEAD, SPHERE(SNOWMAN_X, BODY_Y, BODY_RADIUS), SPHERE(SNOWMAN_X, FEET_Y, FEET_RADIUS), NOSE, ARMS
+};
+static const struct part nose_parts[] = {
+    HEAD, SPHERE(SNOWMAN_X, BODY_Y, BODY_RADIUS), SPHERE(SNOWMAN_X, FEET_Y, FEET_RADIUS), NOSE
+};
+static const struct part melt_parts[] = {
+    HEAD, SPHERE(SNOWMAN_X, LOW_BODY_Y, BODY_RADIUS), SPHERE(SNOWMAN_X, LOW_FEET_Y, FEET_RADIUS)
+};
+
+/* falls are free fall at 1 pixel per frame per frame (3600 px/s^2) until
+ * the part is off the snowman, melts lose 1 pixel of radius per frame */
+static const struct keyframe arms_fall[] = {{0, 0, EASE_IN_QUAD}, {292, 153, EASE_HOLD}};
+static const struct keyframe nose_fall[] = {{0, 0, EASE_IN_QUAD}, {325, 190, EASE_HOLD}};
+static const struct keyframe head_melt[] = {{0, HEAD_RADIUS, EASE_LINEAR}, {417, 0, EASE_HOLD}};
+static const struct keyframe body_melt[] = {{0, BODY_RADIUS, EASE_LINEAR}, {583, 0, EASE_HOLD}};
+static const struct keyframe feet_melt[] = {{0, FEET_RADIUS, EASE_LINEAR}, {750, 0, EASE_HOLD}};
+
+static const struct track arms_tracks[] = {{TRACK_DROP, 2, arms_fall}};
+static const struct track nose_tracks[] = {{TRACK_DROP, 2, nose_fall}};
+static const struct track head_tracks[] = {{TRACK_RADIUS, 2, head_melt}};
+static const struct track body_tracks[] = {{TRACK_RADIUS, 2, body_melt}};
+static const struct track feet_tracks[] = {{TRACK_RADIUS, 2, feet_melt}};
+
+/* indexed by the health left after the miss */
+static const struct melt_effect melt_effects[MAX_HEALTH] = {
+    {melt_parts + 2, 1, 1 << 0, feet_tracks, 1, 3},
+    {melt_parts + 1, 2, 1 << 0, body_tracks, 1, 3},
+    {melt_parts, 3, 1 << 0, head_tracks, 1, 2},
+    {nose_parts, 5, 3 << 3, nose_tracks, 1, 0},
+    {arms_parts, 7, 3 << 5, arms_tracks, 1, 0},
+};
+
+struct sprite melt_backgrounds[MAX_HEALTH];
+
+int track_value(const struct track *track, uint32_t ms){
+    const struct keyframe *k = track->keys;
+    int i = 0;
+    while (i + 1 < track->num_keys && ms >= k[i + 1].ms)
+        i++;
+    if (i + 1 == track->num_keys || ms <= k[i].ms)
+        return k[i].value;
+    int64_t t = ms - k[i].ms, span = k[i + 1].ms - k[i].ms;
+    int64_t change = k[i + 1].value - k[i].value;
+    switch (k[i].easing){
+        case EASE_LINEAR:   return k[i].value + change * t / span;
+        case EASE_IN_QUAD:  return k[i].value + change * t * t / (span * span);
+        case EASE_OUT_QUAD: return k[i].value + change * t * (2 * span - t) / (span * span);
+        default:            return k[i].value;
     }
-    else if (num == 0x42) {
-        return 'k';
+}
+
+uint32_t melt_duration(const struct melt_effect *effect){
+    uint32_t ms = 0;
+    for (int i = 0; i < effect->num_tracks; i++){
+        const struct track *track = &effect->tracks[i];
+        ms = MAX(ms, track->keys[track->num_keys - 1].ms);
     }
-    else if (num == 0x4B) {
-        return 'l';
+    return ms;
+}
+
+void draw_part(const struct part *part, int drop, int radius, struct rect *bounds){
+    // Draw the part moved by drop, with radius if it is >= 0, and grow bounds
+    // to cover it
+    if (part->shape == PART_SPHERE){
+        int r = radius >= 0 ? radius : part->radius, y = part->y0 + drop;
+        draw_sphere(part->x0, y, r, part->color);
+        bounds->x0 = MIN(bounds->x0, part->x0 - r);
+        bounds->y0 = MIN(bounds->y0, y - r);
+        bounds->x1 = MAX(bounds->x1, part->x0 + r + 1);
+        bounds->y1 = MAX(bounds->y1, y + r + 1);
+    } else {
+        draw_line(part->x0, part->y0 + drop, part->x1, part->y1 + drop, part->color);
+        bounds->x0 = MIN(bounds->x0, MIN(part->x0, part->x1));
+        bounds->y0 = MIN(bounds->y0, MIN(part->y0, part->y1) + drop);
+        bounds->x1 = MAX(bounds->x1, MAX(part->x0, part->x1) + 1);
+        bounds->y1 = MAX(bounds->y1, MAX(part->y0, part->y1) + drop + 1);
     }
-    else if (num == 0x3A) {
-        return 'm';
+}
+
+void play_melt(const struct melt_effect *effect, struct sprite *background){
+    // The parts that stay go in the snowman layer, the moving ones and the
+    // drips are redrawn in the effects layer every frame
+    int buffer = select_layer(LAYER_SNOWMAN);
+    if (background->pixels == NULL){
+        struct rect unused = {0, 0, 0, 0};
+        clear_snowman();
+        for (int i = 0; i < effect->num_parts; i++){
+            if (!(effect->moving & (1u << i)))
+                draw_part(&effect->parts[i], 0, -1, &unused);
+        }
+        capture_sprite(background);
+    } else {
+        blit_sprite(background);
     }
-    else if (num == 0x31) {
-        return 'n';
+    select_target(buffer);
+    layer_damage(LAYER_SNOWMAN, SNOWMAN_AREA_X, 0, RESOLUTION_X, RESOLUTION_Y);
+
+    uint32_t duration = melt_duration(effect);
+    uint32_t start = clock_ticks(), ms;
+    particles_reset(&particles, SNOWMAN_AREA_X, 0, RESOLUTION_X, RESOLUTION_Y);
+    do {
+        ms = MIN((clock_ticks() - start) / CLOCK_TICKS_PER_MS, duration);
+        int steps = particles_advance(&particles);
+        int drop = 0, radius = -1;
+        for (int i = 0; i < effect->num_tracks; i++){
+            int value = track_value(&effect->tracks[i], ms);
+            if (effect->tracks[i].property == TRACK_DROP)
+                drop = value;
+            else
+                radius = value;
+        }
+
+        buffer = effects_begin();
+        for (int i = 0; i < effect->num_parts; i++){
+            const struct part *part = &effect->parts[i];
+            if (!(effect->moving & (1u << i)))
+                continue;
+            draw_part(part, drop, radius, &effects_drawn);
+            if (part->shape == PART_SPHERE && ms < duration)
+                particles_drip(&particles, part->x0, part->y0 + drop, radius >= 0 ? radius : part->radius,
+                               steps * effect->drips);
+        }
+        particles_draw(&particles, &effects_drawn);
+        effects_end(buffer);
+        compose();
+        show_frame();
+    } while (ms < duration || particles.count != 0);
+    effects_end(effects_begin());
+}
+
+void draw_transition_animation(const struct round *round){
+    int health = round->health;
+    if (health >= 0 && health < MAX_HEALTH)
+        play_melt(&melt_effects[health], &melt_backgrounds[health]);
+    show_snowman(health);
+}
+
+/* PS/2 scan code set 2 decoding. Keys are reported as lowercase ASCII where
+ * one exists, arrows as KEY_UP..KEY_RIGHT. Codes after an 0xE0 prefix use
+ * ps2_extended_keys; codes without an entry decode to nothing. */
+#define KEY_BACKSPACE '\b'
+#define KEY_ENTER '\n'
+#define KEY_ESCAPE 0x1B
+#define KEY_UP 0x80
+#define KEY_DOWN 0x81
+#define KEY_LEFT 0x82
+#define KEY_RIGHT 0x83
+
+static const unsigned char ps2_keys[256] = {
+    [0x1C] = 'a', [0x32] = 'b', [0x21] = 'c', [0x23] = 'd', [0x24] = 'e', [0x2B] = 'f',
+    [0x34] = 'g', [0x33] = 'h', [0x43] = 'i', [0x3B] = 'j', [0x42] = 'k', [0x4B] = 'l',
+    [0x3A] = 'm', [0x31] = 'n', [0x44] = 'o', [0x4D] = 'p', [0x15] = 'q', [0x2D] = 'r',
+    [0x1B] = 's', [0x2C] = 't', [0x3C] = 'u', [0x2A] = 'v', [0x1D] = 'w', [0x22] = 'x',
+    [0x35] = 'y', [0x1A] = 'z',
+    [0x45] = '0', [0x16] = '1', [0x1E] = '2', [0x26] = '3', [0x25] = '4',
+    [0x2E] = '5', [0x36] = '6', [0x3D] = '7', [0x3E] = '8', [0x46] = '9',
+    // keypad digits
+    [0x70] = '0', [0x69] = '1', [0x72] = '2', [0x7A] = '3', [0x6B] = '4',
+    [0x73] = '5', [0x74] = '6', [0x6C] = '7', [0x75] = '8', [0x7D] = '9',
+    [0x29] = ' ', [0x5A] = KEY_ENTER, [0x66] = KEY_BACKSPACE, [0x76] = KEY_ESCAPE,
+};
+
+static const unsigned char ps2_extended_keys[256] = {
+    [0x75] = KEY_UP, [0x72] = KEY_DOWN, [0x6B] = KEY_LEFT, [0x74] = KEY_RIGHT,
+    [0x5A] = KEY_ENTER,     // keypad enter
+};
+
+struct key_event {
+    unsigned char key;
+    unsigned char pressed;      // FALSE for a break (release) code
+};
+
+struct ps2_decoder {
+    unsigned char extended;     // 0xE0 seen
+    unsigned char released;     // 0xF0 seen
+    unsigned char skip;         // bytes left of the pause key sequence
+};
+
+int ps2_decode(struct ps2_decoder *decoder, int code, struct key_event *event){
+    // Feed one received byte. Returns TRUE and fills *event once a complete
+    // make or break code for a known key has been seen.
+    if (decoder->skip){
+        decoder->skip--;
+        return FALSE;
     }
-    else if (num == 0x44) {
-        return 'o';
+    if (code == 0xE0){
+        decoder->extended = TRUE;
+        return FALSE;
     }
-    else if (num == 0x4D) {
-        return 'p';
+    if (code == 0xF0){
+        decoder->released = TRUE;
+        return FALSE;
     }
-    else if (num == 0x15) {
-        return 'q';
+    if (code == 0xE1){
+        decoder->skip = 7;      // pause sends E1 14 77 E1 F0 14 F0 77 and has no break
+        return FALSE;
     }
-    else if (num == 0x2D) {
-        return 'r';
+    unsigned char key = (decoder->extended ? ps2_extended_keys : ps2_keys)[code & 0xFF];
+    event->key = key;
+    event->pressed = !decoder->released;
+    decoder->extended = FALSE;
+    decoder->released = FALSE;
+    return key != 0;
+}
+
+/* Word dictionary. A dictionary is a single read-only blob made by
+ * tools/mkdict from a plain word list and used in place, without parsing:
+ * mapped from a file on the host (HANGMAN_DICT), or compiled into the program
+ * on the board (-DDICTIONARY_BLOB with the header from mkdict -c). Words are
+ * stored sorted by difficulty, then length, and the bucket table gives the
+ * index range of each (difficulty, length) pair, so picking a word is O(1).
+ * Without a dictionary the built-in word list is used. */
+#define DICT_MAGIC 0x43444D48           // "HMDC"
+#define DICT_VERSION 1
+#define DICT_DIFFICULTIES 3
+#define DICT_MAX_LENGTH 11              // longest word that fits left of the snowman
+
+enum difficulty { EASY, MEDIUM, HARD };
+
+struct dict_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_words;
+    uint32_t buckets_offset;            // struct dict_bucket [DICT_DIFFICULTIES][DICT_MAX_LENGTH + 1]
+    uint32_t index_offset;              // uint32_t string offset of each word
+    uint32_t strings_offset;            // NUL-terminated words
+    uint32_t total_size;
+    uint32_t reserved;
+};
+
+struct dict_bucket {
+    uint32_t first;                     // position in the index
+    uint32_t count;
+};
+
+struct dictionary {
+    const struct dict_header *header;
+    const struct dict_bucket *buckets;
+    const uint32_t *index;
+    const char *strings;
+    uint32_t strings_size;
+};
+
+struct dictionary dictionary;
+
+int dictionary_open(struct dictionary *dict, const void *data, uint32_t size){
+    // Check the blob and point dict into it. Returns FALSE if it is not a
+    // dictionary this program understands. Only the tables are checked here,
+    // so opening costs the same for any number of words: they lie inside the
+    // blob and are aligned, and the buckets cover the index in order. Words
+    // are checked by dictionary_word as they are read.
+    const struct dict_header *header = data;
+    uint32_t num_buckets = DICT_DIFFICULTIES * (DICT_MAX_LENGTH + 1);
+    if (size < sizeof(*header) || ((uintptr_t)data & 3) != 0 || header->magic != DICT_MAGIC
+        || header->version != DICT_VERSION || header->total_size > size || header->total_size < sizeof(*header))
+        return FALSE;
+    uint32_t total = header->total_size;
+    if ((header->buckets_offset & 3) != 0 || header->buckets_offset > total
+        || (total - header->buckets_offset) / sizeof(struct dict_bucket) < num_buckets
+        || (header->index_offset & 3) != 0 || header->index_offset > total
+        || (total - header->index_offset) / sizeof(uint32_t) < header->num_words
+        || header->strings_offset >= total)
+        return FALSE;
+    const struct dict_bucket *buckets = (const struct dict_bucket *)((const char *)data + header->buckets_offset);
+    const uint32_t *index = (const uint32_t *)((const char *)data + header->index_offset);
+    const char *strings = (const char *)data + header->strings_offset;
+    uint32_t strings_size = total - header->strings_offset;
+    uint32_t next = 0;
+    for (uint32_t b = 0; b < num_buckets; b++){
+        if (buckets[b].first != next || buckets[b].count > header->num_words - next)
+            return FALSE;
+        next += buckets[b].count;
     }
-    else if (num == 0x1B) {
-        return 's';
+    if (next != header->num_words)
+        return FALSE;
+    dict->header = header;
+    dict->buckets = buckets;
+    dict->index = index;
+    dict->strings = strings;
+    dict->strings_size = strings_size;
+    return TRUE;
+}
+
+const struct dict_bucket *dictionary_bucket(const struct dictionary *dict, int difficulty, int length){
+    return &dict->buckets[difficulty * (DICT_MAX_LENGTH + 1) + length];
+}
+
+const char *dictionary_word(const struct dictionary *dict, uint32_t i){
+    // Word i of the index, or NULL if it is not a word of 1 to
+    // DICT_MAX_LENGTH letters inside the string area
+    uint32_t offset = dict->index[i];
+    if (offset >= dict->strings_size)
+        return NULL;
+    const char *word = dict->strings + offset;
+    uint32_t room = MIN(dict->strings_size - offset, DICT_MAX_LENGTH + 1);
+    for (uint32_t c = 0; c < room; c++){
+        if (word[c] == '\0')
+            return c > 0 ? word : NULL;
+        if (!letter_bit(word[c]))
+            return NULL;
     }
-    else if (num == 0x2C) {
-        return 't';
+    return NULL;
+}
+
+const char *dictionary_pick(const struct dictionary *dict, int difficulty, unsigned int random){
+    // Uniform pick among all words of a difficulty. Their buckets are
+    // contiguous, so the range is the first bucket's start to the last one's end.
+    const struct dict_bucket *first = dictionary_bucket(dict, difficulty, 0);
+    const struct dict_bucket *last = dictionary_bucket(dict, difficulty, DICT_MAX_LENGTH);
+    uint32_t count = last->first + last->count - first->first;
+    if (count == 0)
+        return NULL;
+    return dictionary_word(dict, first->first + random % count);
+}
+
+#ifdef DICTIONARY_BLOB
+#include DICTIONARY_BLOB
+#endif
+
+#ifdef HOST_SIM
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int dictionary_map_file(struct dictionary *dict, const char *path){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return FALSE;
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return FALSE;
+    if (!dictionary_open(dict, data, st.st_size)){
+        munmap(data, st.st_size);
+        return FALSE;
     }
-    else if (num == 0x3C) {
-        return 'u';
+    return TRUE;
+}
+#endif
+
+void load_dictionary(){
+#ifdef HOST_SIM
+    const char *path = getenv("HANGMAN_DICT");
+    if (path && !dictionary_map_file(&dictionary, path))
+        fprintf(stderr, "%s: not a dictionary, using the built-in words\n", path);
+#elif defined(DICTIONARY_BLOB)
+    dictionary_open(&dictionary, dictionary_blob, sizeof(dictionary_blob));
+#endif
+}
+
+static const char *builtin_words[DICT_DIFFICULTIES][8] = {
+    {EASY1, EASY2, EASY3, EASY4, EASY5},
+    {MEDIUM1, MEDIUM2, MEDIUM3, MEDIUM4, MEDIUM5, MEDIUM6, MEDIUM7, MEDIUM8},
+    {HARD1, HARD2, HARD3, HARD4, HARD5, HARD6, HARD7},
+};
+static const int builtin_counts[DICT_DIFFICULTIES] = {5, 8, 7};
+
+int difficulty_from_keys(int key_value_edge){
+    // KEY1 is easy, KEY2 medium, anything else hard
+    if (key_value_edge == 2)
+        return EASY;
+    if (key_value_edge == 4)
+        return MEDIUM;
+    return HARD;
+}
+
+/* Word choice. A 32-bit xorshift generator seeded once at startup. On the
+ * board it also steps once per menu frame, so the time spent in the menu
+ * picks the word. In the simulator the seed alone decides, because how many
+ * times the loop runs per frame depends on the host (and with -DDUAL_CORE
+ * on thread timing), so the seed and the input log (HANGMAN_SIM_SEED,
+ * HANGMAN_SIM_REPLAY) reproduce every round. */
+#ifdef HOST_SIM
+#define RANDOM_SEED() sim_seed()
+#define RANDOM_MENU_STEP()
+#else
+#define RANDOM_SEED() 0x2545F491u
+#define RANDOM_MENU_STEP() random_next()
+#endif
+
+uint32_t random_state = 1;
+
+void random_seed(uint32_t seed){
+    random_state = seed ? seed : 1;     // xorshift never leaves 0
+}
+
+uint32_t random_next(){
+    uint32_t x = random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return random_state = x;
+}
+
+const char *pick_word(int difficulty, uint32_t random){
+    // From the dictionary if there is one and the word picked in it is
+    // sound, else from the built-in words
+    const char *word = NULL;
+    if (dictionary.header != NULL)
+        word = dictionary_pick(&dictionary, difficulty, random);
+    if (word == NULL)
+        word = builtin_words[difficulty][random % builtin_counts[difficulty]];
+    return word;
+}
+
+const char* generate_word(int difficulty) {
+    return pick_word(difficulty, random_next());
+}
+
+/* Hangman solver for the hint key and the auto-play demo. The candidates
+ * are all known words with the round's length, kept as bit planes with one
+ * bit per word: contains[l] has the words containing letter l, at[p][l] the
+ * words with letter l at position p, alive the words still consistent with
+ * the round. Each guess is applied once, a few AND passes over 64 words at a
+ * time. Choosing a letter is a popcount pass per letter, so it is linear in
+ * candidates / 64 and fits in a frame for large dictionaries. */
+struct solver {
+    int length;
+    int num_words;
+    int num_blocks;             // 64-bit words per plane
+    int capacity;               // blocks allocated per plane
+    int capacity_length;        // positions allocated in at
+    uint64_t *alive;
+    uint64_t *contains;         // [26][num_blocks]
+    uint64_t *at;               // [length][26][num_blocks]
+    uint32_t applied;           // letters already filtered on
+};
+
+static const char solver_fallback_order[] = "etaoinshrdlcumwfgypbvkjxqz";
+
+uint64_t *solver_plane(struct solver *solver, int position, int letter){
+    // position -1 is the contains plane
+    uint64_t *base = (position < 0) ? solver->contains : solver->at + (size_t)position * 26 * solver->capacity;
+    return base + (size_t)letter * solver->capacity;
+}
+
+void solver_add_word(struct solver *solver, const char *word){
+    int w = solver->num_words++;
+    uint64_t bit = 1ULL << (w & 63);
+    int block = w >> 6;
+    solver->alive[block] |= bit;
+    for (int p = 0; p < solver->length; p++){
+        int letter = word[p] - 'a';
+        solver_plane(solver, -1, letter)[block] |= bit;
+        solver_plane(solver, p, letter)[block] |= bit;
     }
-    else if (num == 0x2A) {
-        return 'v';
+}
+
+int solver_prepare(struct solver *solver, int length){
+    // Load every known word of this length as a candidate. Returns FALSE if
+    // the planes can't be allocated.
+    size_t word_length = length;    // to compare with strlen
+    int count = 0;
+    if (dictionary.header != NULL){
+        for (int d = 0; d < DICT_DIFFICULTIES; d++)
+            count += dictionary_bucket(&dictionary, d, length)->count;
+    } else {
+        for (int d = 0; d < DICT_DIFFICULTIES; d++)
+            for (int i = 0; i < builtin_counts[d]; i++)
+                count += strlen(builtin_words[d][i]) == word_length;
     }
-    else if (num == 0x1D) {
-        return 'w';
+
+    int blocks = (count + 63) / 64;
+    if (blocks == 0)
+        blocks = 1;
+    if (blocks > solver->capacity || length > solver->capacity_length){
+        free(solver->alive);
+        free(solver->contains);
+        free(solver->at);
+        solver->capacity = blocks;
+        solver->capacity_length = length;
+        solver->alive = malloc(blocks * sizeof(uint64_t));
+        solver->contains = malloc(26 * blocks * sizeof(uint64_t));
+        solver->at = malloc((size_t)length * 26 * blocks * sizeof(uint64_t));
+        if (!solver->alive || !solver->contains || !solver->at){
+            solver->capacity = solver->capacity_length = 0;
+            solver->length = solver->num_words = solver->num_blocks = 0;
+            return FALSE;
+        }
     }
-    else if (num == 0x22) {
-        return 'x';
+    solver->length = length;
+    solver->num_words = 0;
+    solver->num_blocks = blocks;
+    solver->applied = 0;
+    memset(solver->alive, 0, solver->capacity * sizeof(uint64_t));
+    memset(solver->contains, 0, 26 * solver->capacity * sizeof(uint64_t));
+    memset(solver->at, 0, (size_t)length * 26 * solver->capacity * sizeof(uint64_t));
+
+    if (dictionary.header != NULL){
+        for (int d = 0; d < DICT_DIFFICULTIES; d++){
+            const struct dict_bucket *bucket = dictionary_bucket(&dictionary, d, length);
+            for (uint32_t i = 0; i < bucket->count; i++){
+                const char *word = dictionary_word(&dictionary, bucket->first + i);
+                if (word && strlen(word) == word_length)
+                    solver_add_word(solver, word);
+            }
+        }
+    } else {
+        for (int d = 0; d < DICT_DIFFICULTIES; d++)
+            for (int i = 0; i < builtin_counts[d]; i++)
+                if (strlen(builtin_words[d][i]) == word_length)
+                    solver_add_word(solver, builtin_words[d][i]);
     }
-    else if (num == 0x35) {
-        return 'y';
+    return TRUE;
+}
+
+void solver_restart(struct solver *solver){
+    // Make every loaded word a candidate again, for a new round of the same length
+    memset(solver->alive, 0, solver->num_blocks * sizeof(uint64_t));
+    for (int w = 0; w < solver->num_words; w += 64){
+        int n = solver->num_words - w;
+        solver->alive[w >> 6] = (n >= 64) ? ~0ULL : (1ULL << n) - 1;
     }
-    else if (num == 0x1A) {
-        return 'z';
-    }    
+    solver->applied = 0;
 }
 
-char* generate_word(int difficulty, char* word_array[]) {
-    // Generate random index between 0 and 4
-    
-    if (difficulty == 2) {
-        // Easy
-        int i = rand() % 5;
-        return word_array[i];
+void solver_update(struct solver *solver, const struct round *round){
+    // Filter the candidates on every guess made since the last update
+    uint32_t pending = round->guessed & ~solver->applied;
+    if (solver->length != round->length)
+        pending = 0;
+    while (pending){
+        int letter = __builtin_ctz(pending);
+        pending &= pending - 1;
+        solver->applied |= 1u << letter;
+
+        uint64_t *contains = solver_plane(solver, -1, letter);
+        if (!(round->letters & (1u << letter))){
+            for (int b = 0; b < solver->num_blocks; b++)
+                solver->alive[b] &= ~contains[b];
+            continue;
+        }
+        // a hit: the letter is at exactly the revealed positions
+        for (int p = 0; p < round->length; p++){
+            uint64_t *at = solver_plane(solver, p, letter);
+            if (round->word[p] == 'a' + letter){
+                for (int b = 0; b < solver->num_blocks; b++)
+                    solver->alive[b] &= at[b];
+            } else {
+                for (int b = 0; b < solver->num_blocks; b++)
+                    solver->alive[b] &= ~at[b];
+            }
+        }
     }
-    else if (difficulty == 4) {
-        // Medium
-        int i = rand() % 8;
-        return word_array[i+5];
+}
+
+uint64_t n_log2_n(uint32_t n){
+    // n * log2(n) in 16.16 fixed point, log2 from the leading bit and a
+    // quadratic fit of the mantissa
+    if (n <= 1)
+        return 0;
+    int e = 31 - __builtin_clz(n);
+    uint32_t f = (e >= 16) ? (n >> (e - 16)) & 0xFFFF : (n << (16 - e)) & 0xFFFF;
+    uint32_t log2 = (e << 16) + f + (uint32_t)((((uint64_t)f * (65536 - f)) >> 16) * 22713 >> 16);
+    return (uint64_t)n * log2;
+}
+
+char solver_best_letter(struct solver *solver, const struct round *round){
+    // The unguessed letter whose outcome splits the candidates best: the
+    // outcomes are a miss or a hit grouped by the first position the letter
+    // is in, and the best letter minimises sum(n * log2 n) over them, which
+    // maximises the expected information. Ties go to the letter most likely
+    // to hit.
+    solver_update(solver, round);
+    int total = 0;
+    for (int b = 0; b < solver->num_blocks; b++)
+        total += __builtin_popcountll(solver->alive[b]);
+
+    int best = -1;
+    uint64_t best_cost = 0;
+    int best_hits = -1;
+    if (total > 0){
+        for (int letter = 0; letter < 26; letter++){
+            if (round->guessed & (1u << letter))
+                continue;
+            int first_at[DICT_MAX_LENGTH] = {0};
+            int hits = 0;
+            for (int b = 0; b < solver->num_blocks; b++){
+                uint64_t seen = 0;
+                uint64_t alive = solver->alive[b];
+                if (!alive)
+                    continue;
+                for (int p = 0; p < solver->length; p++){
+                    uint64_t here = solver_plane(solver, p, letter)[b] & alive;
+                    first_at[p] += __builtin_popcountll(here & ~seen);
+                    seen |= here;
+                }
+                hits += __builtin_popcountll(seen);
+            }
+            if (hits == 0)
+                continue;
+            uint64_t cost = n_log2_n(total - hits);
+            for (int p = 0; p < solver->length; p++)
+                cost += n_log2_n(first_at[p]);
+            if (best < 0 || cost < best_cost || (cost == best_cost && hits > best_hits)){
+                best = letter;
+                best_cost = cost;
+                best_hits = hits;
+            }
+        }
     }
-    else {
-        // Hard
-        int i = rand() % 7;
-        return word_array[i+13];
+    if (best >= 0)
+        return 'a' + best;
+
+    // no candidate fits (the word is not in the dictionary): common letters first
+    for (const char *c = solver_fallback_order; *c; c++){
+        if (!(round->guessed & letter_bit(*c)))
+            return *c;
     }
+    return 0;
 }
 
+int play_guess(struct round *round, char letter){
+    // Apply a guess on the game screen and return the next game state
+    enum guess_result result = round_guess(round, letter);
+    if (result == GUESS_HIT) {
+        draw_current_word(round, round->revealed, FALSE);
+    } else if (result == GUESS_MISS) {
+        draw_current_guesses(round);
+        draw_transition_animation(round);
+        if (round_lost(round)) {
+            play_sound(440, 1000); // 440 Hz, 1 s
+            return 2;
+        }
+    }
+    return 1;
+}
+
+void draw_hint(char hint){
+    char text[] = "Hint  ?";
+    if (hint)
+        text[6] = hint;
+    else
+        memset(text, ' ', 7);
+    text_put(TEXT_COL, HINT_ROW, text, 7);
+}
+
+#ifndef HANGMAN_NO_MAIN
 int main(void)
 {
-    volatile int * pixel_ctrl_ptr = (int *)0xFF203020;
     // declare other variables(not shown)
     // initialize location and direction of rectangles(not shown)
 
-    /* set front pixel buffer to start of FPGA On-chip memory */
-    *(pixel_ctrl_ptr + 1) = 0xC8000000; // first store the address in the 
-                                        // back buffer
-    /* now, swap the front/back buffers, to set the front buffer location */
-    wait_for_vsync();
-    /* initialize a pointer to the pixel buffer, used by drawing functions */
-    pixel_buffer_start = *pixel_ctrl_ptr;
-    clear_screen(); // pixel_buffer_start points to the pixel buffer
-    /* set back pixel buffer to start of SDRAM memory */
-    *(pixel_ctrl_ptr + 1) = 0xC0000000;
-    pixel_buffer_start = *(pixel_ctrl_ptr + 1); // we draw on the back buffer
-    clear_screen(); // pixel_buffer_start points to the pixel buffer
+    init_interrupts();
+    clock_init();
+    profile_init();
+    capture_init();
+
+    /* clear the pixel buffers, show on-chip memory and draw in SDRAM */
+    present_init();
+    layers_init();
+    text_clear();
+#ifdef DUAL_CORE
+    start_render_core();    // core 1 draws and shows every frame from here on
+#endif
 
     // Snowman health states (list of points to draw for each health value):
     //6 health --> filled circle for head, filled circle for body, filled circle for feet
     //int health_6[];
 
-    char* wordArray[] = {EASY1,EASY2,EASY3,EASY4,EASY5,MEDIUM1,MEDIUM2,MEDIUM3,MEDIUM4,MEDIUM5,
-                        MEDIUM6, MEDIUM7, MEDIUM8, HARD1,HARD2,HARD3,HARD4,HARD5,HARD6,HARD7};
-
-    int SnowmanHealth = 5;
-    volatile int* PS2_ADDRESS = 0xFF200100;
-    volatile int* LED_ADDRESS = LEDR_BASE;
-    volatile int* KEY_ADDRESS = 0xFF20005C;
-    int PS2_data, RVALID;
+    load_dictionary();
+    random_seed(RANDOM_SEED());
+
+    struct round round = {0};
+    struct solver solver = {0};
+    char hint = 0;
+    int autoplay_timer = 0;
+    int scancode;
+    struct ps2_decoder decoder = {0};
+    struct key_event event;
+    int key_held = 0;           // key being held down, its repeats are ignored
     unsigned char key_val;
 
     //Game State Integer
     int game_state = 0;
     int difficulty = 0;
 
-    //temporary word
-    char* word;
-    /* for (int i =0 ; i < 5; i++){
-        letter_states[i] = 0;
-    } */
 
     while (1)
     {
-        int key_value_edge = (*(KEY_ADDRESS))&0xF;
+        int key_value_edge = IO_READ(KEY_EDGE_BASE)&0xF;
         if (key_value_edge == 1) {
-            clear_screen();
             game_state = 0;
-            SnowmanHealth = 5;
-            free(letter_states);
-            int len = strlen(wrong_guesses);
-            strcpy(wrong_guesses, "");
+            stop_sounds();
+            profile_dump();     // KEY0 also reports the frame profile
+            text_clear();
             //write back to the edgecapture register to reset it
-            *(KEY_ADDRESS) = 0xF;
-            //clear both buffers
-            wait_for_vsync();
-            pixel_buffer_start = *(pixel_ctrl_ptr + 1);
-            clear_screen();
-            wait_for_vsync();
-            pixel_buffer_start = *(pixel_ctrl_ptr + 1);
-        }
-        *(KEY_ADDRESS) = 0xF;
+            IO_WRITE(KEY_EDGE_BASE, 0xF);
+            clear_all_buffers();
+        }
+        IO_WRITE(KEY_EDGE_BASE, 0xF);
         if (game_state == 0) {
             //Draw starting screen, wait for button press to determine difficulty
-            draw_word(26, "Welcome to Melting Snowman", 10, 180, WHITE);
-            draw_word(29, "Select difficulty by pressing", 10, 200, WHITE);
-            draw_word(16, "key one to three", 10, 220, WHITE);
-            wait_for_vsync();
-            pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
-            PS2_data = *(PS2_ADDRESS);
+            text_message(45, "Welcome to Melting Snowman");
+            text_message(50, "Select difficulty by pressing");
+            text_message(55, "key one to three");
+            show_frame();
+            ps2_ring_flush();
+            memset(&decoder, 0, sizeof(decoder));
+            key_held = 0;
+            RANDOM_MENU_STEP();
             if (key_value_edge > 1) {
-                difficulty = key_value_edge; // Switch to edgecaptures if needed
+                difficulty = difficulty_from_keys(key_value_edge);
                 game_state = 1;
-                clear_screen();
-                wait_for_vsync();
-                pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
-                clear_screen();
-                wait_for_vsync();
-                pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
+                text_clear();
+                clear_all_buffers();
                 //Generate random word based on difficulty
                 //word = "hello";
-                word = generate_word(difficulty, wordArray);
-
-                // initialize letter_states
-                letter_states = calloc(strlen(word), sizeof(int));
+                round_start(&round, generate_word(difficulty));
+                if (solver.length == round.length)
+                    solver_restart(&solver);
+                else
+                    solver_prepare(&solver, round.length);
+                hint = 0;
+                layers_reset(round.health);
 
             }
             
@@ -642,109 +2980,96 @@ int main(void)
         }
         else if (game_state == 1) {
             //Draw game screen, wait for key input to determine if snowman is hit or character is guessed
-            draw_current_snowman(SnowmanHealth);
-            draw_current_word(word, WHITE);
-            draw_current_guesses();
-            // Read from PS2
-            PS2_data = *(PS2_ADDRESS);
-            RVALID = (PS2_data & 0x8000);
-            if (RVALID != 0)
+            //Only the parts that changed since this buffer was last drawn are redrawn
+            compose();
+            // text cells are only written when they change
+            draw_current_word(&round, round.revealed, FALSE);
+            draw_current_guesses(&round);
+            draw_hint(hint);
+            // Handle every key received since the last frame. Releases and
+            // the repeats sent while a key is held are not guesses.
+            PROBE_BEGIN(STAGE_INPUT);
+            while (game_state == 1 && (scancode = ps2_ring_pop()) >= 0)
             {
-                key_val = PS2_data & 0xFF;
-                if (key_val != 0xF0) {
-                    key_val = convert_to_ascii(key_val);
-
-                    //check if key_val is inside the word
-                    //if not, decrement health
-                    int key_in_word = 0;
-                    for (int i = 0; i < strlen(word); i++) {
-                        if (key_val == word[i]) {
-                            key_in_word = 1;
-                            letter_states[i] = 1;
-                        }
-                    }
-
-                    if (!key_in_word) {
-                        SnowmanHealth--;
-                        draw_transition_animation(SnowmanHealth,word);
-                        char tmp[2] = {key_val, '\0'};
-                        strcat(wrong_guesses, tmp);
-                        if (SnowmanHealth == 0) {
-                            game_state = 2;
-                        }
-                    }
+                if (!ps2_decode(&decoder, scancode, &event)) {
+                    continue;
                 }
-
-                // delay so we stop reading in key input for a cycle
-                for (int i = 0; i < 1000000; i++){
-                    // do nothing
-                    PS2_data = *(PS2_ADDRESS);
+                if (!event.pressed) {
+                    if (event.key == key_held)
+                        key_held = 0;
+                } else if (event.key != key_held) {
+                    key_held = event.key;
+                    if (event.key == KEY_ENTER) {
+                        // hint: show the solver's choice
+                        hint = solver_best_letter(&solver, &round);
+                        draw_hint(hint);
+                        continue;
+                    }
+                    if (event.key < 'a' || event.key > 'z')
+                        continue;   // only letters are guesses
+                    key_val = event.key;
+                    game_state = play_guess(&round, key_val);
                 }
-            
             }
-            else {
-                //if no key is pressed set key_val to 0
-                key_val = 0;
+            PROBE_END(STAGE_INPUT);
+
+            // auto-play demo: the solver guesses while SW0 is on
+            if (game_state == 1 && (IO_READ(SW_BASE) & 1) && ++autoplay_timer >= AUTOPLAY_FRAMES) {
+                autoplay_timer = 0;
+                char letter = solver_best_letter(&solver, &round);
+                if (letter)
+                    game_state = play_guess(&round, letter);
             }
-            int win = 1;
-            // check for win condition
-            for (int i = 0; i < strlen(word); i++){
-                if (letter_states[i] == 0){
-                    win = 0;
-                }
+            if (hint && (round.guessed & letter_bit(hint))) {
+                hint = 0;
+                draw_hint(hint);
             }
 
-            if (win){
+            // check for win condition
+            if (game_state == 1 && round_won(&round)){
                 game_state = 3;
+                play_sound(880, 1000); // 880 Hz, 1 s
+                show_snowman(MAX_HEALTH);
+                particles_reset(&particles, 0, 0, RESOLUTION_X, RESOLUTION_Y);
             } 
 
 
-            wait_for_vsync();
-            pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
+            show_frame();
         }
         else if (game_state == 2) {     // LOSS
             //Draw game over screen, prompt restart option
-            wait_for_vsync();
-            pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
-            clear_screen();
-            draw_current_snowman(0);    // draw with 0 hp
-
-            // reset states so that the things appear
-            draw_current_word(word, WHITE);
-            for (int i = 0 ; i < strlen(word); i++){
-                letter_states[i] = !letter_states[i];
-            }
-            
+            //The snowman layer has the 0 hp snowman since the last melt
+            compose();
+            show_frame();
 
-            draw_current_word(word, RED);
-            for (int i = 0 ; i < strlen(word); i++){
-                letter_states[i] = !letter_states[i];
-            }
+            // the letters that were missing in uppercase
+            draw_current_word(&round, round.revealed, TRUE);
             
             // draw "YOU LOST"
-            draw_word(8, "You Lost", 10, 190, RED);
-            draw_word(21, "Press KEYO to Restart", 10, 210, RED);
-            play_sound(440, 1000); // 880 Hz, 500 ms
+            text_message(47, "You Lost");
+            text_message(52, "Press KEYO to Restart");
 
-            PS2_data = *(PS2_ADDRESS);
+            ps2_ring_flush();
 
         } else if (game_state == 3){    // win
-            wait_for_vsync();
-            pixel_buffer_start = *(pixel_ctrl_ptr + 1); // new back buffer
-            clear_screen();
-            draw_current_snowman(5);    // draw with max hp
-            draw_current_word(word, GREEN);
+            int buffer = effects_begin();
+            particles_snow(&particles, SNOW_PER_STEP * particles_advance(&particles));
+            particles_draw(&particles, &effects_drawn);
+            effects_end(buffer);
+            compose();
+            show_frame();
+            draw_current_word(&round, round.revealed, FALSE);
             // draw "YOU WON"
-            draw_word(7, "You Won", 10, 190, GREEN);
-            draw_word(21, "Press KEYO to Restart", 10, 210, GREEN);
-            play_sound(880, 1000); // 880 Hz, 500 ms
+            text_message(47, "You Won");
+            text_message(52, "Press KEYO to Restart");
 
-            PS2_data = *(PS2_ADDRESS);
+            ps2_ring_flush();
             
         }
-        *(LED_ADDRESS) = game_state; 
+        IO_WRITE(LEDR_BASE, game_state); 
         
 
         
     }
 }
+#endif
@@ -0,0 +1,826 @@
+/* In-process DE1-SoC device model, see de1soc_sim.h. */
+
+#include "de1soc_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define SDRAM_BASE_ADDR       0xC0000000u
+#define SDRAM_SIM_SIZE        (4u << 20)
+#define ONCHIP_BASE_ADDR      0xC8000000u
+#define ONCHIP_SIZE           (256u << 10)
+#define CHAR_BASE_ADDR        0xC9000000u
+#define CHAR_SIZE             (8u << 10)
+
+#define LEDR_ADDR             0xFF200000u
+#define HEX3_HEX0_ADDR        0xFF200020u
+#define HEX5_HEX4_ADDR        0xFF200030u
+#define SW_ADDR               0xFF200040u
+#define KEY_ADDR              0xFF200050u
+#define KEY_EDGE_ADDR         0xFF20005Cu
+#define PS2_ADDR              0xFF200100u
+#define PIXEL_CTRL_ADDR       0xFF203020u
+#define AUDIO_ADDR            0xFF203040u
+
+#define PS2_FIFO_SIZE         256
+#define DEFAULT_MAX_FRAMES    600
+#define DEFAULT_SEED          1
+
+#define LOG_MAGIC             "HGLG"
+#define LOG_VERSION           1
+
+enum sim_event_kind { EV_KEY, EV_PS2, EV_SW, EV_QUIT };    // values are written to input logs
+
+struct sim_event {
+    uint64_t frame;
+    int kind;
+    uint32_t value;
+};
+
+static struct {
+    int ready;
+
+    char *sdram;
+    char *onchip;
+    char *chars;
+
+    /* pixel buffer controller */
+    uint32_t front;
+    uint32_t back;
+    int swap_pending;
+
+    /* virtual clock */
+    uint64_t now_ns;
+    uint64_t frame;
+    uint64_t max_frames;
+
+    /* input */
+    uint8_t ps2_fifo[PS2_FIFO_SIZE];
+    int ps2_head, ps2_count;
+    uint64_t ps2_overflow;
+    uint32_t ps2_ctrl;
+    uint32_t key_edge;
+    uint32_t switches;
+    struct sim_event *events;
+    size_t num_events, cap_events, next_event;
+    uint32_t seed;
+    FILE *record;               // input log being written
+    uint64_t record_frame;      // frame of the last logged event
+
+    /* per-frame trace */
+    FILE *trace;
+    struct timespec trace_mark;
+
+    /* output */
+    uint32_t ledr, hex3_0, hex5_4;
+    int audio_level[2];
+    uint64_t audio_consumed;
+    uint64_t audio_accepted, audio_dropped, audio_underrun;
+    uint32_t audio_ctrl;
+    FILE *audio_out;
+
+    void (*irq_handlers[SIM_NUM_IRQS])(void);
+
+    /* with a second core running, device accesses are serialized */
+    int multicore;
+    pthread_mutex_t lock;
+
+    struct timespec wall_start;
+} sim;
+
+/* character overlay font, printable ASCII from 0x20, rows top to bottom,
+ * bit 0 is the leftmost pixel */
+static const uint8_t char_font[95][8] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},   /* space */
+    {0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00},   /* ! */
+    {0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},   /* " */
+    {0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00},   /* # */
+    {0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00},   /* $ */
+    {0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00},   /* % */
+    {0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00},   /* & */
+    {0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00},   /* ' */
+    {0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00},   /* ( */
+    {0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00},   /* ) */
+    {0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00},   /* asterisk */
+    {0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00},   /* + */
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06},   /* , */
+    {0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00},   /* - */
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00},   /* . */
+    {0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00},   /* slash */
+    {0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00},   /* 0 */
+    {0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00},   /* 1 */
+    {0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00},   /* 2 */
+    {0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00},   /* 3 */
+    {0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00},   /* 4 */
+    {0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00},   /* 5 */
+    {0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00},   /* 6 */
+    {0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00},   /* 7 */
+    {0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00},   /* 8 */
+    {0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00},   /* 9 */
+    {0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00},   /* : */
+    {0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06},   /* ; */
+    {0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00},   /* < */
+    {0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00},   /* = */
+    {0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00},   /* > */
+    {0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00},   /* ? */
+    {0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00},   /* @ */
+    {0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00},   /* A */
+    {0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00},   /* B */
+    {0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00},   /* C */
+    {0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00},   /* D */
+    {0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00},   /* E */
+    {0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00},   /* F */
+    {0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00},   /* G */
+    {0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00},   /* H */
+    {0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00},   /* I */
+    {0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00},   /* J */
+    {0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00},   /* K */
+    {0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00},   /* L */
+    {0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00},   /* M */
+    {0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00},   /* N */
+    {0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00},   /* O */
+    {0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00},   /* P */
+    {0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00},   /* Q */
+    {0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00},   /* R */
+    {0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00},   /* S */
+    {0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00},   /* T */
+    {0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00},   /* U */
+    {0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00},   /* V */
+    {0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00},   /* W */
+    {0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00},   /* X */
+    {0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00},   /* Y */
+    {0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00},   /* Z */
+    {0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00},   /* [ */
+    {0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00},   /* backslash */
+    {0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00},   /* ] */
+    {0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00},   /* ^ */
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF},   /* _ */
+    {0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00},   /* ` */
+    {0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00},   /* a */
+    {0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00},   /* b */
+    {0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00},   /* c */
+    {0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00},   /* d */
+    {0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00},   /* e */
+    {0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00},   /* f */
+    {0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F},   /* g */
+    {0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00},   /* h */
+    {0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00},   /* i */
+    {0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E},   /* j */
+    {0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00},   /* k */
+    {0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00},   /* l */
+    {0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00},   /* m */
+    {0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00},   /* n */
+    {0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00},   /* o */
+    {0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F},   /* p */
+    {0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78},   /* q */
+    {0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00},   /* r */
+    {0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00},   /* s */
+    {0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00},   /* t */
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00},   /* u */
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00},   /* v */
+    {0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00},   /* w */
+    {0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00},   /* x */
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F},   /* y */
+    {0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00},   /* z */
+    {0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00},   /* { */
+    {0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00},   /* | */
+    {0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00},   /* } */
+    {0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},   /* ~ */
+};
+
+/* letters a-z in scan code set 2 */
+static const uint8_t letter_codes[26] = {
+    0x1C, 0x32, 0x21, 0x23, 0x24, 0x2B, 0x34, 0x33, 0x43, 0x3B, 0x42, 0x4B, 0x3A,
+    0x31, 0x44, 0x4D, 0x15, 0x2D, 0x1B, 0x2C, 0x3C, 0x2A, 0x1D, 0x22, 0x35, 0x1A
+};
+
+static void sim_summary(void);
+static void deliver_events(void);
+
+static void push_event(uint64_t frame, int kind, uint32_t value)
+{
+    if (sim.num_events == sim.cap_events) {
+        sim.cap_events = sim.cap_events ? sim.cap_events * 2 : 64;
+        sim.events = realloc(sim.events, sim.cap_events * sizeof(*sim.events));
+        if (!sim.events) {
+            perror("sim: events");
+            exit(1);
+        }
+    }
+    /* keep the queue ordered by frame, events for the same frame stay in order */
+    size_t i = sim.num_events++;
+    while (i > sim.next_event && sim.events[i - 1].frame > frame) {
+        sim.events[i] = sim.events[i - 1];
+        i--;
+    }
+    sim.events[i].frame = frame;
+    sim.events[i].kind = kind;
+    sim.events[i].value = value;
+}
+
+void sim_queue_key(uint64_t frame, uint32_t bits)
+{
+    push_event(frame, EV_KEY, bits);
+}
+
+void sim_queue_switches(uint64_t frame, uint32_t bits)
+{
+    push_event(frame, EV_SW, bits);
+}
+
+void sim_queue_ps2(uint64_t frame, uint8_t code)
+{
+    push_event(frame, EV_PS2, code);
+}
+
+void sim_queue_type(uint64_t frame, const char *letters)
+{
+    for (; *letters; letters++) {
+        char c = *letters;
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if (c < 'a' || c > 'z')
+            continue;
+        sim_queue_ps2(frame, letter_codes[c - 'a']);
+        sim_queue_ps2(frame + 1, 0xF0);
+        sim_queue_ps2(frame + 1, letter_codes[c - 'a']);
+        frame += SIM_TYPE_GAP;
+    }
+}
+
+int sim_load_script(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+
+    char line[512];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+
+        unsigned long long frame;
+        char kind[16];
+        int used;
+        if (sscanf(line, " %llu %15s %n", &frame, kind, &used) < 2)
+            continue;
+        char *args = line + used;
+
+        if (strcmp(kind, "key") == 0) {
+            sim_queue_key(frame, (uint32_t)strtoul(args, NULL, 0));
+        } else if (strcmp(kind, "sw") == 0) {
+            sim_queue_switches(frame, (uint32_t)strtoul(args, NULL, 0));
+        } else if (strcmp(kind, "ps2") == 0) {
+            char *end;
+            for (;;) {
+                unsigned long code = strtoul(args, &end, 16);
+                if (end == args)
+                    break;
+                sim_queue_ps2(frame, (uint8_t)code);
+                args = end;
+            }
+        } else if (strcmp(kind, "type") == 0) {
+            args[strcspn(args, "\r\n")] = '\0';
+            sim_queue_type(frame, args);
+        } else if (strcmp(kind, "quit") == 0) {
+            push_event(frame, EV_QUIT, 0);
+        } else {
+            fprintf(stderr, "sim: %s:%d: unknown event '%s'\n", path, line_no, kind);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static void queue_demo_round(void)
+{
+    /* easy difficulty, then the alphabet in order */
+    sim_queue_key(5, 0x2);
+    sim_queue_type(20, "etaoinshrdlucmfwypvbgkqjxz");
+}
+
+static void put_varint(FILE *f, uint64_t v)
+{
+    while (v >= 0x80) {
+        fputc((int)(v & 0x7F) | 0x80, f);
+        v >>= 7;
+    }
+    fputc((int)v, f);
+}
+
+static int get_varint(FILE *f, uint64_t *v)
+{
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(f);
+        if (c == EOF)
+            return -1;
+        *v |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+static void record_event(int kind, uint32_t value)
+{
+    put_varint(sim.record, sim.frame - sim.record_frame);
+    fputc(kind, sim.record);
+    put_varint(sim.record, value);
+    sim.record_frame = sim.frame;
+}
+
+static int open_record(const char *path)
+{
+    if (!(sim.record = fopen(path, "wb")))
+        return -1;
+    fwrite(LOG_MAGIC, 1, 4, sim.record);
+    fputc(LOG_VERSION, sim.record);
+    for (int i = 0; i < 4; i++)
+        fputc((sim.seed >> (8 * i)) & 0xFF, sim.record);
+    return 0;
+}
+
+int sim_load_replay(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return -1;
+    unsigned char header[9];
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) || memcmp(header, LOG_MAGIC, 4) != 0 ||
+        header[4] != LOG_VERSION) {
+        fprintf(stderr, "sim: %s: not an input log\n", path);
+        fclose(f);
+        return -1;
+    }
+    sim.seed = header[5] | header[6] << 8 | header[7] << 16 | (uint32_t)header[8] << 24;
+
+    uint64_t frame = 0, delta, value;
+    int kind;
+    while (get_varint(f, &delta) == 0) {
+        if ((kind = fgetc(f)) == EOF || kind > EV_QUIT || get_varint(f, &value) != 0) {
+            fprintf(stderr, "sim: %s: truncated input log\n", path);
+            break;
+        }
+        frame += delta;
+        push_event(frame, kind, (uint32_t)value);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* FNV-1a over the visible pixels and characters, a word at a time */
+static uint64_t screen_hash(void)
+{
+    uint64_t h = 0xCBF29CE484222325ULL, w;
+    const char *fb = (const char *)sim_front_buffer();
+    for (int y = 0; y < SIM_RESOLUTION_Y; y++)
+        for (int x = 0; x < SIM_RESOLUTION_X * 2; x += 8) {
+            memcpy(&w, fb + (y << 10) + x, 8);
+            h = (h ^ w) * 0x100000001B3ULL;
+        }
+    for (int row = 0; row < SIM_CHAR_ROWS; row++)
+        for (int col = 0; col < SIM_CHAR_COLS; col += 8) {
+            memcpy(&w, sim.chars + (row << 7) + col, 8);
+            h = (h ^ w) * 0x100000001B3ULL;
+        }
+    return h;
+}
+
+static void trace_frame(void)
+{
+    /* the time spent hashing is left out of the next frame */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ns = (uint64_t)(now.tv_sec - sim.trace_mark.tv_sec) * 1000000000ULL + now.tv_nsec -
+                  sim.trace_mark.tv_nsec;
+    fprintf(sim.trace, "%llu %016llx %llu\n", (unsigned long long)sim.frame,
+            (unsigned long long)screen_hash(), (unsigned long long)ns);
+    clock_gettime(CLOCK_MONOTONIC, &sim.trace_mark);
+}
+
+void sim_init(void)
+{
+    if (sim.ready)
+        return;
+    sim.ready = 1;
+
+    sim.sdram = calloc(1, SDRAM_SIM_SIZE);
+    sim.onchip = calloc(1, ONCHIP_SIZE);
+    sim.chars = calloc(1, CHAR_SIZE);
+    if (!sim.sdram || !sim.onchip || !sim.chars) {
+        perror("sim: memory");
+        exit(1);
+    }
+    sim.front = ONCHIP_BASE_ADDR;
+    sim.back = ONCHIP_BASE_ADDR;
+    sim.max_frames = DEFAULT_MAX_FRAMES;
+    sim.seed = DEFAULT_SEED;
+
+    const char *env = getenv("HANGMAN_SIM_SEED");
+    if (env)
+        sim.seed = (uint32_t)strtoul(env, NULL, 0);
+    env = getenv("HANGMAN_SIM_REPLAY");
+    if (env) {
+        if (sim_load_replay(env) != 0) {
+            perror(env);
+            exit(1);
+        }
+        sim.max_frames = UINT64_MAX;    // the log ends the run
+    } else if ((env = getenv("HANGMAN_SIM_SCRIPT"))) {
+        if (sim_load_script(env) != 0) {
+            perror(env);
+            exit(1);
+        }
+    } else {
+        queue_demo_round();
+    }
+    env = getenv("HANGMAN_SIM_FRAMES");
+    if (env)
+        sim.max_frames = strtoull(env, NULL, 0);
+    env = getenv("HANGMAN_SIM_RECORD");
+    if (env && open_record(env) != 0) {
+        perror(env);
+        exit(1);
+    }
+    env = getenv("HANGMAN_SIM_TRACE");
+    if (env && !(sim.trace = fopen(env, "w"))) {
+        perror(env);
+        exit(1);
+    }
+    env = getenv("HANGMAN_SIM_AUDIO");
+    if (env && !(sim.audio_out = fopen(env, "wb"))) {
+        perror(env);
+        exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &sim.wall_start);
+    sim.trace_mark = sim.wall_start;
+    atexit(sim_summary);
+    deliver_events();
+}
+
+void sim_set_irq_handler(int irq, void (*handler)(void))
+{
+    if (irq >= 0 && irq < SIM_NUM_IRQS)
+        sim.irq_handlers[irq] = handler;
+}
+
+static void raise_ps2_irq(void)
+{
+    if ((sim.ps2_ctrl & 1) && sim.ps2_count > 0 && sim.irq_handlers[SIM_IRQ_PS2])
+        sim.irq_handlers[SIM_IRQ_PS2]();
+}
+
+static void deliver_events(void)
+{
+    while (sim.next_event < sim.num_events && sim.events[sim.next_event].frame <= sim.frame) {
+        struct sim_event *ev = &sim.events[sim.next_event++];
+        if (sim.record && ev->kind != EV_QUIT)
+            record_event(ev->kind, ev->value);
+        switch (ev->kind) {
+        case EV_KEY:
+            sim.key_edge |= ev->value & 0xF;
+            break;
+        case EV_SW:
+            sim.switches = ev->value & 0x3FF;
+            break;
+        case EV_PS2:
+            if (sim.ps2_count == PS2_FIFO_SIZE) {
+                sim.ps2_overflow++;
+            } else {
+                sim.ps2_fifo[(sim.ps2_head + sim.ps2_count) % PS2_FIFO_SIZE] = (uint8_t)ev->value;
+                sim.ps2_count++;
+            }
+            break;
+        case EV_QUIT:
+            exit(0);
+        }
+    }
+    raise_ps2_irq();
+}
+
+static void drain_audio(void)
+{
+    uint64_t played = sim.now_ns * SIM_AUDIO_RATE / 1000000000ULL;
+    int drained = (int)(played - sim.audio_consumed);
+    sim.audio_consumed = played;
+    for (int ch = 0; ch < 2; ch++) {
+        if (sim.audio_level[ch] < drained && (sim.audio_ctrl & 0x2))
+            sim.audio_underrun += drained - sim.audio_level[ch];
+        sim.audio_level[ch] = sim.audio_level[ch] > drained ? sim.audio_level[ch] - drained : 0;
+    }
+}
+
+static void raise_audio_irq(void)
+{
+    /* WE: the codec interrupts while the write FIFOs are at least 75% empty */
+    int free_space = SIM_AUDIO_FIFO_DEPTH - (sim.audio_level[0] > sim.audio_level[1] ? sim.audio_level[0] : sim.audio_level[1]);
+    if ((sim.audio_ctrl & 0x2) && free_space >= SIM_AUDIO_FIFO_DEPTH * 3 / 4 && sim.irq_handlers[SIM_IRQ_AUDIO])
+        sim.irq_handlers[SIM_IRQ_AUDIO]();
+}
+
+/* move the virtual clock forward, running every vsync boundary on the way;
+ * while the audio write interrupt is enabled time moves in small steps so
+ * the handler can keep the FIFOs fed */
+static void advance_to(uint64_t t)
+{
+    while (sim.now_ns < t) {
+        uint64_t next_vsync = (sim.frame + 1) * SIM_VSYNC_PERIOD_NS;
+        uint64_t next = next_vsync < t ? next_vsync : t;
+        if ((sim.audio_ctrl & 0x2) && sim.now_ns + SIM_AUDIO_STEP_NS < next)
+            next = sim.now_ns + SIM_AUDIO_STEP_NS;
+        sim.now_ns = next;
+        drain_audio();
+        raise_audio_irq();
+        if (next != next_vsync)
+            continue;
+
+        sim.frame++;
+        if (sim.swap_pending) {
+            uint32_t tmp = sim.front;
+            sim.front = sim.back;
+            sim.back = tmp;
+            sim.swap_pending = 0;
+        }
+        if (sim.trace)
+            trace_frame();
+        deliver_events();
+        if (sim.frame >= sim.max_frames)
+            exit(0);
+    }
+}
+
+static void audio_write(int ch, uint32_t value)
+{
+    if (sim.audio_level[ch] >= SIM_AUDIO_FIFO_DEPTH) {
+        sim.audio_dropped++;
+        return;
+    }
+    sim.audio_level[ch]++;
+    sim.audio_accepted++;
+    if (sim.audio_out) {
+        int32_t sample = (int32_t)value;
+        fwrite(&sample, sizeof(sample), 1, sim.audio_out);
+    }
+}
+
+static void lock_devices(void)
+{
+    if (!sim.multicore)
+        return;
+    pthread_mutex_lock(&sim.lock);
+}
+
+static void unlock_devices(void)
+{
+    if (sim.multicore)
+        pthread_mutex_unlock(&sim.lock);
+}
+
+static uint32_t io_read(uint32_t addr)
+{
+    switch (addr) {
+    case PIXEL_CTRL_ADDR:
+        return sim.front;
+    case PIXEL_CTRL_ADDR + 4:
+        return sim.back;
+    case PIXEL_CTRL_ADDR + 8:
+        return (SIM_RESOLUTION_Y << 16) | SIM_RESOLUTION_X;
+    case PIXEL_CTRL_ADDR + 12:
+        /* polling a pending swap waits out the rest of the frame */
+        if (sim.swap_pending)
+            advance_to((sim.frame + 1) * SIM_VSYNC_PERIOD_NS);
+        return sim.swap_pending ? 1 : 0;
+    case PS2_ADDR:
+        if (sim.ps2_count == 0)
+            return 0;
+        {
+            uint8_t code = sim.ps2_fifo[sim.ps2_head];
+            sim.ps2_head = (sim.ps2_head + 1) % PS2_FIFO_SIZE;
+            sim.ps2_count--;
+            return ((uint32_t)sim.ps2_count << 16) | 0x8000 | code;
+        }
+    case PS2_ADDR + 4:
+        return sim.ps2_ctrl | (sim.ps2_count > 0 && (sim.ps2_ctrl & 1) ? 0x100 : 0);
+    case KEY_EDGE_ADDR:
+        return sim.key_edge;
+    case KEY_ADDR:
+        return 0;
+    case SW_ADDR:
+        return sim.switches;
+    case LEDR_ADDR:
+        return sim.ledr;
+    case HEX3_HEX0_ADDR:
+        return sim.hex3_0;
+    case HEX5_HEX4_ADDR:
+        return sim.hex5_4;
+    case AUDIO_ADDR:
+        return sim.audio_ctrl;
+    case AUDIO_ADDR + 4: {
+        uint32_t wsrc = SIM_AUDIO_FIFO_DEPTH - sim.audio_level[1];
+        uint32_t wslc = SIM_AUDIO_FIFO_DEPTH - sim.audio_level[0];
+        return (wslc << 24) | (wsrc << 16);
+    }
+    default:
+        return 0;
+    }
+}
+
+uint32_t sim_io_read(uint32_t addr)
+{
+    sim_init();
+    lock_devices();
+    uint32_t value = io_read(addr);
+    unlock_devices();
+    return value;
+}
+
+void sim_io_write(uint32_t addr, uint32_t value)
+{
+    sim_init();
+    lock_devices();
+    switch (addr) {
+    case PIXEL_CTRL_ADDR:
+        sim.swap_pending = 1;
+        break;
+    case PIXEL_CTRL_ADDR + 4:
+        sim.back = value;
+        break;
+    case PS2_ADDR + 4:
+        sim.ps2_ctrl = value & 1;
+        raise_ps2_irq();
+        break;
+    case KEY_EDGE_ADDR:
+        sim.key_edge &= ~value;
+        break;
+    case LEDR_ADDR:
+        sim.ledr = value;
+        break;
+    case HEX3_HEX0_ADDR:
+        sim.hex3_0 = value;
+        break;
+    case HEX5_HEX4_ADDR:
+        sim.hex5_4 = value;
+        break;
+    case AUDIO_ADDR:
+        if (value & 0x8)
+            sim.audio_level[0] = sim.audio_level[1] = 0;
+        sim.audio_ctrl = value & 0x3;
+        raise_audio_irq();
+        break;
+    case AUDIO_ADDR + 8:
+        audio_write(0, value);
+        break;
+    case AUDIO_ADDR + 12:
+        audio_write(1, value);
+        break;
+    default:
+        break;
+    }
+    unlock_devices();
+}
+
+char *sim_mem(uint32_t addr)
+{
+    sim_init();
+    if (addr >= ONCHIP_BASE_ADDR && addr < ONCHIP_BASE_ADDR + ONCHIP_SIZE)
+        return sim.onchip + (addr - ONCHIP_BASE_ADDR);
+    if (addr >= CHAR_BASE_ADDR && addr < CHAR_BASE_ADDR + CHAR_SIZE)
+        return sim.chars + (addr - CHAR_BASE_ADDR);
+    if (addr >= SDRAM_BASE_ADDR && addr < SDRAM_BASE_ADDR + SDRAM_SIM_SIZE)
+        return sim.sdram + (addr - SDRAM_BASE_ADDR);
+    fprintf(stderr, "sim: access to unmapped memory 0x%08x\n", addr);
+    abort();
+}
+
+static void *core_thread(void *entry)
+{
+    ((void (*)(void))entry)();
+    return NULL;
+}
+
+int sim_start_core(int core, void (*entry)(void))
+{
+    sim_init();
+    if (!sim.multicore) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&sim.lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        sim.multicore = 1;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, core_thread, (void *)entry) != 0) {
+        fprintf(stderr, "sim: can't start core %d\n", core);
+        exit(1);
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+void sim_cpu_relax(void)
+{
+    sched_yield();
+}
+
+uint32_t sim_seed(void)
+{
+    sim_init();
+    return sim.seed;
+}
+
+uint64_t sim_frame(void)
+{
+    return sim.frame;
+}
+
+uint64_t sim_time_ns(void)
+{
+    return sim.now_ns;
+}
+
+void sim_set_max_frames(uint64_t frames)
+{
+    sim_init();
+    sim.max_frames = frames;
+}
+
+const uint16_t *sim_front_buffer(void)
+{
+    return (const uint16_t *)sim_mem(sim.front);
+}
+
+/* the VGA output: each pixel buffer pixel is 2x2 on the 640x480 screen, and
+ * the character buffer's 80x60 cells are 8x8 on top of it, white on a
+ * transparent background */
+int sim_write_ppm(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return -1;
+    const uint16_t *fb = sim_front_buffer();
+    fprintf(f, "P6\n%d %d\n255\n", SIM_VGA_X, SIM_VGA_Y);
+    unsigned char line[SIM_VGA_X * 3];
+    for (int y = 0; y < SIM_VGA_Y; y++) {
+        const uint8_t *cells = (const uint8_t *)sim.chars + ((y >> 3) << 7);
+        for (int x = 0; x < SIM_VGA_X; x++) {
+            unsigned char *rgb = &line[x * 3];
+            uint8_t c = cells[x >> 3];
+            if (c > 0x20 && c < 0x7F && (char_font[c - 0x20][y & 7] >> (x & 7) & 1)) {
+                rgb[0] = rgb[1] = rgb[2] = 255;
+                continue;
+            }
+            uint16_t p = fb[((y >> 1) << 9) + (x >> 1)];
+            rgb[0] = (unsigned char)(((p >> 11) & 0x1F) * 255 / 31);
+            rgb[1] = (unsigned char)(((p >> 5) & 0x3F) * 255 / 63);
+            rgb[2] = (unsigned char)((p & 0x1F) * 255 / 31);
+        }
+        fwrite(line, 1, sizeof(line), f);
+    }
+    fclose(f);
+    return 0;
+}
+
+static void sim_summary(void)
+{
+    if (sim.audio_out)
+        fclose(sim.audio_out);
+    if (sim.record) {
+        /* the run ends where the recording did */
+        put_varint(sim.record, sim.frame - sim.record_frame);
+        fputc(EV_QUIT, sim.record);
+        put_varint(sim.record, 0);
+        if (fclose(sim.record) != 0)
+            perror("sim: input log");
+    }
+    if (sim.trace && fclose(sim.trace) != 0)
+        perror("sim: trace");
+
+    const char *ppm = getenv("HANGMAN_SIM_PPM");
+    if (ppm && sim_write_ppm(ppm) != 0)
+        perror(ppm);
+
+    if (getenv("HANGMAN_SIM_QUIET"))
+        return;
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double wall = (end.tv_sec - sim.wall_start.tv_sec) + (end.tv_nsec - sim.wall_start.tv_nsec) / 1e9;
+    double virt = sim.now_ns / 1e9;
+    fprintf(stderr,
+            "sim: %llu frames, %.2f s virtual, %.3f s wall (%.1f frames/s), leds 0x%x\n"
+            "sim: audio %llu samples accepted, %llu dropped, %llu underrun; ps2 overflow %llu\n",
+            (unsigned long long)sim.frame, virt, wall, wall > 0 ? sim.frame / wall : 0.0, sim.ledr,
+            (unsigned long long)sim.audio_accepted, (unsigned long long)sim.audio_dropped,
+            (unsigned long long)sim.audio_underrun,
+            (unsigned long long)sim.ps2_overflow);
+}
@@ -0,0 +1,96 @@
+/* In-process model of the DE1-SoC devices used by main.c.
+ *
+ * Built with -DHOST_SIM, main.c routes every register access and every pixel
+ * buffer address through these functions instead of dereferencing the board
+ * addresses. The model keeps two framebuffers (on-chip and SDRAM), a pixel
+ * buffer controller whose vsync status bit follows a virtual 60 Hz clock, the
+ * character buffer overlay, a scripted PS/2 FIFO and KEY edge capture
+ * register, LEDs and an audio sink.
+ *
+ * Runtime configuration comes from the environment so that main() keeps its
+ * board signature:
+ *   HANGMAN_SIM_SCRIPT  input script (see sim_load_script), default demo round
+ *   HANGMAN_SIM_FRAMES  number of presented frames before exiting (default 600,
+ *                       no limit with a replay)
+ *   HANGMAN_SIM_SEED    seed for the game's word choice (default 1)
+ *   HANGMAN_SIM_RECORD  write every delivered input event and the seed to this
+ *                       input log
+ *   HANGMAN_SIM_REPLAY  play this input log instead of a script, with its seed
+ *   HANGMAN_SIM_TRACE   write "<frame> <hash> <wall ns>" for every vsync: a
+ *                       hash of the screen as shown and the host time taken
+ *                       since the previous vsync
+ *   HANGMAN_SIM_PPM     write the final screen (front buffer and characters) here
+ *   HANGMAN_SIM_AUDIO   write accepted audio samples (s32 stereo) to this file
+ *   HANGMAN_SIM_QUIET   suppress the summary printed at exit
+ */
+#ifndef DE1SOC_SIM_H
+#define DE1SOC_SIM_H
+
+#include <stdint.h>
+
+#define SIM_RESOLUTION_X      320
+#define SIM_RESOLUTION_Y      240
+#define SIM_VGA_X             640       // screen, with the character overlay
+#define SIM_VGA_Y             480
+#define SIM_CHAR_COLS         80
+#define SIM_CHAR_ROWS         60
+#define SIM_VSYNC_PERIOD_NS   16666667ULL
+#define SIM_AUDIO_RATE        48000
+#define SIM_AUDIO_FIFO_DEPTH  128
+#define SIM_AUDIO_STEP_NS     500000ULL
+
+void sim_init(void);
+
+uint32_t sim_io_read(uint32_t addr);
+void sim_io_write(uint32_t addr, uint32_t value);
+/* translate a device memory address (pixel or character buffer) to host memory */
+char *sim_mem(uint32_t addr);
+
+/* input script: one event per line, "<frame> <kind> <args>"
+ *   <frame> key <bits>       set KEY edge capture bits
+ *   <frame> sw <bits>        set the slide switches
+ *   <frame> ps2 <hex> ...    push raw scancode bytes
+ *   <frame> type <letters>   make/break codes, one letter every SIM_TYPE_GAP frames
+ *   <frame> quit             stop the simulation
+ * '#' starts a comment. Returns 0 on success, -1 if the file can't be read. */
+int sim_load_script(const char *path);
+void sim_queue_key(uint64_t frame, uint32_t bits);
+void sim_queue_switches(uint64_t frame, uint32_t bits);
+void sim_queue_ps2(uint64_t frame, uint8_t code);
+void sim_queue_type(uint64_t frame, const char *letters);
+
+/* Input log: "HGLG", a version byte (1) and the seed as 32-bit little
+ * endian, then one record per event: the frames since the previous record
+ * and the value as LEB128 varints around a kind byte (0 KEY edge, 1 PS/2
+ * byte, 2 switches, 3 end of run). Returns 0 on success, -1 if the file
+ * can't be read or isn't a log. */
+int sim_load_replay(const char *path);
+/* seed the game uses, from HANGMAN_SIM_SEED or the replayed log */
+uint32_t sim_seed(void);
+
+/* Interrupt lines. A handler registered here is called, like an ISR, as soon
+ * as its device raises the interrupt and the device's interrupt enable bit is
+ * set (RE in the PS/2 control register, WE in the audio control register). */
+#define SIM_IRQ_AUDIO         78
+#define SIM_IRQ_PS2           79
+#define SIM_NUM_IRQS          256
+void sim_set_irq_handler(int irq, void (*handler)(void));
+
+/* Runs entry on another simulated core (a host thread). From then on device
+ * accesses are serialized, and an interrupt handler runs on the core whose
+ * access raised the interrupt, never two at once. Build with -pthread. */
+int sim_start_core(int core, void (*entry)(void));
+/* spin-wait hint, yields the host CPU */
+void sim_cpu_relax(void);
+
+uint64_t sim_frame(void);
+uint64_t sim_time_ns(void);
+void sim_set_max_frames(uint64_t frames);
+/* front buffer of the pixel buffer controller */
+const uint16_t *sim_front_buffer(void);
+/* the screen as shown, SIM_VGA_X x SIM_VGA_Y with the character overlay */
+int sim_write_ppm(const char *path);
+
+#define SIM_TYPE_GAP 8
+
+#endif
@@ -0,0 +1,64 @@
+/* Fill rate of the screen clears, old per-pixel column-major loop against
+ * fill_rect. Runs against the simulated framebuffer:
+ *
+ *   gcc -O2 -DHOST_SIM tools/bench_fill.c sim/de1soc_sim.c -o bench_fill
+ *   ./bench_fill [iterations]
+ */
+#define HANGMAN_NO_MAIN
+#include "../main.c"
+
+#include <time.h>
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* clear_screen as it was before fill_rect, one recorded pixel at a time */
+static void clear_screen_per_pixel(void)
+{
+    for (int i = 0; i < RESOLUTION_X; i++){
+        for (int j = 0; j < RESOLUTION_Y; j++){
+            plot_pixel(i, j, 0x0000);
+        }
+    }
+}
+
+static void clear_snowman_per_pixel(void)
+{
+    for (int i = SNOWMAN_AREA_X; i < RESOLUTION_X; i++){
+        for (int j = 0; j < RESOLUTION_Y; j++){
+            plot_pixel(i, j, 0x0000);
+        }
+    }
+}
+
+static void report(const char *name, void (*fn)(void), int pixels, int iterations)
+{
+    fn();   // warm up
+    display_list_flush();
+    double start = now_seconds();
+    for (int i = 0; i < iterations; i++) {
+        fn();
+        display_list_flush();
+    }
+    double elapsed = now_seconds() - start;
+    double bytes = (double)pixels * 2 * iterations;
+    printf("%-26s %9.1f MB/s %9.1f us/call\n", name, bytes / elapsed / 1e6, elapsed / iterations * 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    int screen = RESOLUTION_X * RESOLUTION_Y;
+    int snowman = (RESOLUTION_X - SNOWMAN_AREA_X) * RESOLUTION_Y;
+
+    select_target(0);
+    report("clear_screen (per pixel)", clear_screen_per_pixel, screen, iterations);
+    report("clear_screen (fill_rect)", clear_screen, screen, iterations);
+    report("clear_snowman (per pixel)", clear_snowman_per_pixel, snowman, iterations);
+    report("clear_snowman (fill_rect)", clear_snowman, snowman, iterations);
+    return 0;
+}
@@ -0,0 +1,82 @@
+/* Particle throughput: particles stepped and plotted per millisecond, and
+ * the frame rate a full pool allows. Runs against the simulated framebuffer:
+ *
+ *   gcc -O2 -DHOST_SIM tools/bench_particles.c sim/de1soc_sim.c -o bench_particles
+ *   ./bench_particles [particles] [iterations]
+ *
+ * The pool (default MAX_PARTICLES) is spread over the screen with a long
+ * life and no motion out of it, so the count stays the same while the
+ * stages are timed: the move kernel alone (the scalar loop, and NEON where
+ * it is built), a whole step with retiring, plotting (recording and
+ * rasterizing the points), and a step and plot together as in a frame.
+ */
+#define HANGMAN_NO_MAIN
+#include "../main.c"
+
+#include <time.h>
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_pool(int n)
+{
+    particles_reset(&particles, 0, 0, RESOLUTION_X, RESOLUTION_Y);
+    for (int i = 0; i < n; i++) {
+        particle_spawn(&particles, particle_random(&particles, RESOLUTION_X) << PARTICLE_SHIFT,
+                       particle_random(&particles, RESOLUTION_Y) << PARTICLE_SHIFT,
+                       0, 0, 0, 1 << 30, WHITE, 0);
+    }
+}
+
+static void move_scalar(void) { particles_move_scalar(&particles, 0); }
+static void move(void)        { particles_move(&particles); }
+static void step(void)        { particles_step(&particles); }
+
+static void plot(void)
+{
+    particles_draw(&particles, NULL);
+    display_list_flush();
+}
+
+static void frame(void)
+{
+    particles_step(&particles);
+    plot();
+}
+
+static void report(const char *name, void (*fn)(void), int n, int iterations)
+{
+    fill_pool(n);
+    fn();   // warm up
+    double start = now_seconds();
+    for (int i = 0; i < iterations; i++)
+        fn();
+    double elapsed = now_seconds() - start;
+    double per_call = elapsed / iterations;
+    printf("%-16s %12.0f particles/ms %9.2f us/call %9.0f calls/s\n", name,
+           particles.count / (per_call * 1e3), per_call * 1e6, 1 / per_call);
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : MAX_PARTICLES;
+    int iterations = argc > 2 ? atoi(argv[2]) : 5000;
+    n = MIN(MAX(n, 1), MAX_PARTICLES);
+
+    select_target(0);
+    printf("%d particles\n", n);
+    report("move (scalar)", move_scalar, n, iterations);
+#ifdef __ARM_NEON
+    report("move (neon)", move, n, iterations);
+#else
+    (void)move;
+#endif
+    report("step", step, n, iterations);
+    report("plot", plot, n, iterations);
+    report("step + plot", frame, n, iterations);
+    return 0;
+}
@@ -0,0 +1,106 @@
+/* Frame throughput of the game loop on one core against the dual-core split.
+ * Build it twice:
+ *
+ *   gcc -O2 -DHOST_SIM tools/bench_pipeline.c sim/de1soc_sim.c -o bench_single -pthread
+ *   gcc -O2 -DHOST_SIM -DDUAL_CORE tools/bench_pipeline.c sim/de1soc_sim.c -o bench_dual -pthread
+ *   ./bench_single [frames] [logic us] [scenes]
+ *
+ * Every frame spends the given time on game logic (default 500 us), then
+ * draws the whole screen the given number of times (default 20): a clear,
+ * the full snowman and three lines of text. Vsync costs nothing in the
+ * simulator, so frames per second is the rate at which the loop can
+ * produce frames. On one core it is bounded by logic + rendering, with the
+ * render core by the larger of the two. Latency is measured separately,
+ * one frame at a time: the time from the start of a frame's logic until the
+ * frame has been drawn and shown.
+ */
+#define HANGMAN_NO_MAIN
+#include "../main.c"
+
+#include <time.h>
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* game logic stand-in: a fixed amount of work, calibrated before the render
+ * core starts so that it takes the requested time on an idle core */
+static volatile uint32_t logic_state = 1;
+static double logic_loops_per_us;
+
+static void logic(double us)
+{
+    uint32_t x = logic_state;
+    for (long n = (long)(us * logic_loops_per_us); n > 0; n--)
+        x = x * 1664525u + 1013904223u;
+    logic_state = x;
+}
+
+static void calibrate_logic(void)
+{
+    logic_loops_per_us = 1;
+    long loops = 1 << 20;
+    double start = now_seconds();
+    logic(loops);
+    logic_loops_per_us = loops / ((now_seconds() - start) * 1e6);
+}
+
+static void scene(int frame)
+{
+    char text[] = "Frame      ";
+    for (int i = 10, n = frame; i > 5 && n; i--, n /= 10)
+        text[i] = '0' + n % 10;
+    clear_screen();
+    render_snowman(5);
+    draw_word(26, "Welcome to Melting Snowman", 10, 180, WHITE);
+    draw_word(29, "Select difficulty by pressing", 10, 200, WHITE);
+    draw_word(11, text, 10, 220, WHITE);
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 1000;
+    double logic_us = argc > 2 ? atof(argv[2]) : 500;
+    int scenes = argc > 3 ? atoi(argv[3]) : 20;
+
+    calibrate_logic();
+    sim_set_max_frames(UINT64_MAX);
+    present_init();
+#ifdef DUAL_CORE
+    start_render_core();
+#endif
+
+    /* back to back, the way the game runs */
+    double start = now_seconds();
+    for (int f = 0; f < frames; f++) {
+        logic(logic_us);
+        for (int s = 0; s < scenes; s++)
+            scene(f);
+        show_frame();
+    }
+    double throughput = frames / (now_seconds() - start);
+
+    /* one frame at a time, waiting until each one is shown */
+    double latency = 0;
+    for (int f = 0; f < frames; f++) {
+        double frame_start = now_seconds();
+        logic(logic_us);
+        for (int s = 0; s < scenes; s++)
+            scene(f);
+        show_frame();
+        display_list_finish();
+        latency += now_seconds() - frame_start;
+    }
+
+#ifdef DUAL_CORE
+    const char *mode = "dual core";
+#else
+    const char *mode = "single core";
+#endif
+    printf("%-12s %8.1f frames/s %8.1f us latency (%d frames, %.0f us logic, %d scenes)\n", mode,
+           throughput, latency / frames * 1e6, frames, logic_us, scenes);
+    return 0;
+}
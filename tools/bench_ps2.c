@@ -0,0 +1,264 @@
+/* PS/2 decoder check and microbenchmark.
+ *
+ * Before timing, every one of the 256 byte values is decoded as a plain
+ * make code, a break code (F0 xx) and an extended make and break (E0 xx,
+ * E0 F0 xx). Each result is checked against the old convert_to_ascii
+ * chain for letters, and against a scan code list written out here, not
+ * the decoder's tables, for the other keys. Then a random
+ * stream of scancodes is decoded, with the old chain timed on the same
+ * stream for comparison.
+ *
+ *   gcc -O2 -DHOST_SIM tools/bench_ps2.c sim/de1soc_sim.c -o bench_ps2
+ *   ./bench_ps2 [stream bytes]
+ */
+#define HANGMAN_NO_MAIN
+#include "../main.c"
+
+#include <time.h>
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the letter codes the old if/else chain recognised, in alphabet order */
+static const unsigned char old_letter_codes[26] = {
+    0x1C, 0x32, 0x21, 0x23, 0x24, 0x2B, 0x34, 0x33, 0x43, 0x3B, 0x42, 0x4B, 0x3A,
+    0x31, 0x44, 0x4D, 0x15, 0x2D, 0x1B, 0x2C, 0x3C, 0x2A, 0x1D, 0x22, 0x35, 0x1A
+};
+
+/* convert_to_ascii as it was before the tables, except that it returns 0
+ * instead of falling off the end for codes it doesn't know */
+static int old_convert_to_ascii(int num)
+{
+    // Convert number to ASCII
+    if (num == 0x1C) {
+        return 'a';
+    }
+    else if (num == 0x32) {
+        return 'b';
+    }
+    else if (num == 0x21) {
+        return 'c';
+    }
+    else if (num == 0x23) {
+        return 'd';
+    }
+    else if (num == 0x24) {
+        return 'e';
+    }
+    else if (num == 0x2B) {
+        return 'f';
+    }
+    else if (num == 0x34) {
+        return 'g';
+    }
+    else if (num == 0x33) {
+        return 'h';
+    }
+    else if (num == 0x43) {
+        return 'i';
+    }
+    else if (num == 0x3B) {
+        return 'j';
+    }
+    else if (num == 0x42) {
+        return 'k';
+    }
+    else if (num == 0x4B) {
+        return 'l';
+    }
+    else if (num == 0x3A) {
+        return 'm';
+    }
+    else if (num == 0x31) {
+        return 'n';
+    }
+    else if (num == 0x44) {
+        return 'o';
+    }
+    else if (num == 0x4D) {
+        return 'p';
+    }
+    else if (num == 0x15) {
+        return 'q';
+    }
+    else if (num == 0x2D) {
+        return 'r';
+    }
+    else if (num == 0x1B) {
+        return 's';
+    }
+    else if (num == 0x2C) {
+        return 't';
+    }
+    else if (num == 0x3C) {
+        return 'u';
+    }
+    else if (num == 0x2A) {
+        return 'v';
+    }
+    else if (num == 0x1D) {
+        return 'w';
+    }
+    else if (num == 0x22) {
+        return 'x';
+    }
+    else if (num == 0x35) {
+        return 'y';
+    }
+    else if (num == 0x1A) {
+        return 'z';
+    }
+    return 0;
+}
+
+/* The keys the decoder added: scan code set 2, written out from the
+ * keyboard's code list rather than taken from ps2_keys */
+struct reference_key {
+    unsigned char code;
+    unsigned char key;
+};
+
+static const struct reference_key reference_keys[] = {
+    {0x45, '0'}, {0x16, '1'}, {0x1E, '2'}, {0x26, '3'}, {0x25, '4'},
+    {0x2E, '5'}, {0x36, '6'}, {0x3D, '7'}, {0x3E, '8'}, {0x46, '9'},
+    {0x70, '0'}, {0x69, '1'}, {0x72, '2'}, {0x7A, '3'}, {0x6B, '4'},     // keypad
+    {0x73, '5'}, {0x74, '6'}, {0x6C, '7'}, {0x75, '8'}, {0x7D, '9'},
+    {0x29, ' '}, {0x5A, '\n'}, {0x66, '\b'}, {0x76, 0x1B},
+};
+
+static const struct reference_key reference_extended_keys[] = {
+    {0x75, KEY_UP}, {0x72, KEY_DOWN}, {0x6B, KEY_LEFT}, {0x74, KEY_RIGHT}, {0x5A, '\n'},
+};
+
+/* what a code should decode to, 0xFF for nothing */
+static int reference_key(const struct reference_key *keys, int n, int code)
+{
+    for (int i = 0; i < n; i++) {
+        if (keys[i].code == code)
+            return keys[i].key;
+    }
+    return 0xFF;
+}
+
+static int failures;
+
+static void expect(int code, const char *what, int got, int want)
+{
+    if (got != want) {
+        printf("FAIL 0x%02X %s: got 0x%02X want 0x%02X\n", code, what, got, want);
+        failures++;
+    }
+}
+
+/* feed a byte sequence, return the last event or key 0xFF if none completed */
+static struct key_event feed(const int *bytes, int n)
+{
+    struct ps2_decoder decoder = {0};
+    struct key_event event = {0xFF, 0};
+    struct key_event out;
+    for (int i = 0; i < n; i++) {
+        if (ps2_decode(&decoder, bytes[i], &out))
+            event = out;
+    }
+    return event;
+}
+
+static void check_all_codes(void)
+{
+    for (int code = 0; code < 256; code++) {
+        if (code == 0xE0 || code == 0xF0 || code == 0xE1)
+            continue;   // prefixes, checked through the sequences below
+        int old = old_convert_to_ascii(code);
+        int want = old ? old : reference_key(reference_keys, sizeof(reference_keys) / sizeof(reference_keys[0]), code);
+        int want_ext = reference_key(reference_extended_keys,
+                                     sizeof(reference_extended_keys) / sizeof(reference_extended_keys[0]), code);
+
+        int make[] = {code};
+        int brk[] = {0xF0, code};
+        int ext_make[] = {0xE0, code};
+        int ext_brk[] = {0xE0, 0xF0, code};
+        struct key_event e;
+
+        e = feed(make, 1);
+        expect(code, "make", e.key, want);
+        if (want != 0xFF)
+            expect(code, "make pressed", e.pressed, TRUE);
+        e = feed(brk, 2);
+        expect(code, "break", e.key, want);
+        if (want != 0xFF)
+            expect(code, "break pressed", e.pressed, FALSE);
+        e = feed(ext_make, 2);
+        expect(code, "extended make", e.key, want_ext);
+        e = feed(ext_brk, 3);
+        expect(code, "extended break", e.key, want_ext);
+        if (want_ext != 0xFF)
+            expect(code, "extended break pressed", e.pressed, FALSE);
+    }
+
+    /* a released key must not be reported again as a press */
+    int release_then_make[] = {0x1C, 0xF0, 0x1C};
+    struct ps2_decoder decoder = {0};
+    struct key_event e;
+    int presses = 0;
+    for (int i = 0; i < 3; i++) {
+        if (ps2_decode(&decoder, release_then_make[i], &e) && e.pressed)
+            presses++;
+    }
+    expect(0x1C, "presses in make/break", presses, 1);
+
+    /* pause produces nothing and leaves the decoder ready */
+    int pause_then_a[] = {0xE1, 0x14, 0x77, 0xE1, 0xF0, 0x14, 0xF0, 0x77, 0x1C};
+    e = feed(pause_then_a, 9);
+    expect(0xE1, "pause then a", e.key, 'a');
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 20000000;
+
+    check_all_codes();
+    if (failures) {
+        printf("%d decoder checks failed\n", failures);
+        return 1;
+    }
+    printf("decoder: all 256 codes consistent as make, break, extended make and extended break\n");
+
+    /* a typing-like stream: make, then F0 + make, over letter codes */
+    unsigned char *stream = malloc(n);
+    srand(1);
+    for (int i = 0; i + 2 < n; i += 3) {
+        unsigned char code = old_letter_codes[rand() % 26];
+        stream[i] = code;
+        stream[i + 1] = 0xF0;
+        stream[i + 2] = code;
+    }
+    for (int i = n - n % 3; i < n; i++)
+        stream[i] = 0x1C;
+
+    struct ps2_decoder decoder = {0};
+    struct key_event event;
+    unsigned long sum = 0;
+    double start = now_seconds();
+    for (int i = 0; i < n; i++) {
+        if (ps2_decode(&decoder, stream[i], &event))
+            sum += event.key + event.pressed;
+    }
+    double table = now_seconds() - start;
+
+    start = now_seconds();
+    for (int i = 0; i < n; i++) {
+        if (stream[i] != 0xF0)
+            sum += old_convert_to_ascii(stream[i]);
+    }
+    double chain = now_seconds() - start;
+
+    printf("ps2_decode        %6.2f ns/byte\n", table / n * 1e9);
+    printf("convert_to_ascii  %6.2f ns/byte (linear compare)\n", chain / n * 1e9);
+    printf("checksum %lu\n", sum);
+    free(stream);
+    return 0;
+}
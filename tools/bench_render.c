@@ -0,0 +1,299 @@
+/* Rendering microbenchmarks for every draw primitive, with a JSON report
+ * and a regression check against a stored baseline.
+ *
+ *   gcc -O2 -DHOST_SIM tools/bench_render.c sim/de1soc_sim.c -o bench_render
+ *   ./bench_render [-m ms] [-r runs] [-o out.json] [-b baseline.json] [-t percent]
+ *
+ * Every call is followed by display_list_flush, so the time includes both
+ * recording the commands and rasterizing them. Each benchmark is repeated
+ * for at least -m milliseconds (default 100), -r times (default 5), and the
+ * fastest run is kept. The report gives ns per
+ * call, pixels written per call and per second, and frames per second for
+ * the benchmarks that draw a whole frame. It is written as JSON to -o, or
+ * to stdout.
+ *
+ * With -b, every benchmark is compared with the same name in the baseline,
+ * which is an earlier report. A benchmark regresses when its ns per call is
+ * more than -t percent (default 10) above the baseline; a "threshold" field
+ * in a baseline entry overrides -t for that benchmark. The exit status is 1
+ * if anything regressed. tools/bench_render.json is the baseline for the
+ * current renderer; timings depend on the host, so regenerate it with -o on
+ * the machine that runs the comparison.
+ */
+#define HANGMAN_NO_MAIN
+#include "../main.c"
+
+#include <time.h>
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* plot_pixel walks the screen so consecutive calls don't hit one address */
+static int plot_x, plot_y;
+
+static void bench_plot_pixel(void)
+{
+    plot_pixel(plot_x, plot_y, WHITE);
+    if (++plot_x == RESOLUTION_X) {
+        plot_x = 0;
+        if (++plot_y == RESOLUTION_Y)
+            plot_y = 0;
+    }
+}
+
+static void bench_line_shallow(void)    { draw_line(10, 100, 309, 160, GREEN); }
+static void bench_line_steep(void)      { draw_line(140, 5, 200, 234, GREEN); }
+static void bench_line_horizontal(void) { draw_line(10, 120, 309, 120, GREEN); }
+static void bench_line_vertical(void)   { draw_line(160, 5, 160, 234, GREEN); }
+
+static void bench_sphere_head(void) { draw_sphere(260, 120, HEAD_RADIUS, WHITE); }
+static void bench_sphere_body(void) { draw_sphere(260, 120, BODY_RADIUS, WHITE); }
+static void bench_sphere_feet(void) { draw_sphere(260, 120, FEET_RADIUS, WHITE); }
+
+static void bench_letter(void) { draw_letter('w', 20, 70, WHITE); }
+static void bench_word(void)   { draw_word(26, "Welcome to Melting Snowman", 10, 180, WHITE); }
+
+static void bench_clear_screen(void) { clear_screen(); }
+
+/* every melt step, health 4 down to 0, as played after five misses */
+static void bench_transition(void)
+{
+    struct round round;
+    round_start(&round, "snowman");
+    for (int health = MAX_HEALTH - 1; health >= 0; health--) {
+        round.health = health;
+        draw_transition_animation(&round);
+    }
+}
+
+struct bench {
+    const char *name;
+    void (*fn)(void);
+    int whole_frame;        // report frames per second
+    int animation;          // presents frames itself, pixels are not counted
+    /* results */
+    double ns_per_call;
+    double pixels_per_call;
+    double frames_per_call;
+};
+
+static struct bench benches[] = {
+    {.name = "plot_pixel", .fn = bench_plot_pixel},
+    {.name = "draw_line_shallow", .fn = bench_line_shallow},
+    {.name = "draw_line_steep", .fn = bench_line_steep},
+    {.name = "draw_line_horizontal", .fn = bench_line_horizontal},
+    {.name = "draw_line_vertical", .fn = bench_line_vertical},
+    {.name = "draw_sphere_head", .fn = bench_sphere_head},
+    {.name = "draw_sphere_body", .fn = bench_sphere_body},
+    {.name = "draw_sphere_feet", .fn = bench_sphere_feet},
+    {.name = "draw_letter", .fn = bench_letter},
+    {.name = "draw_word", .fn = bench_word},
+    {.name = "clear_screen", .fn = bench_clear_screen, .whole_frame = 1},
+    {.name = "transition_animation", .fn = bench_transition, .whole_frame = 1, .animation = 1},
+};
+#define NUM_BENCHES ((int)(sizeof(benches) / sizeof(benches[0])))
+
+/* pixels one call writes: draw into a black buffer and count what changed,
+ * clear_screen writes the whole screen in black */
+static double pixels_per_call(struct bench *b)
+{
+    if (b->fn == bench_clear_screen)
+        return RESOLUTION_X * RESOLUTION_Y;
+    fill_rect(0, 0, RESOLUTION_X, RESOLUTION_Y, 0x0000);
+    b->fn();
+    display_list_flush();
+    int count = 0;
+    for (int y = 0; y < RESOLUTION_Y; y++) {
+        const uint16_t *row = (const uint16_t *)(back_buffer.pixels + (y << 10));
+        for (int x = 0; x < RESOLUTION_X; x++)
+            count += row[x] != 0;
+    }
+    return count;
+}
+
+static void call(struct bench *b)
+{
+    b->fn();
+    display_list_flush();
+}
+
+static void run(struct bench *b, double min_seconds, int runs)
+{
+    if (!b->animation)
+        b->pixels_per_call = pixels_per_call(b);
+
+    uint64_t frame = sim_frame();
+    call(b);    // warm up, and count the frames an animation presents
+    b->frames_per_call = b->animation ? (double)(sim_frame() - frame) : 1;
+
+    /* grow the batch until one run takes long enough to time */
+    long iterations = 1;
+    for (;;) {
+        double start = now_seconds();
+        for (long i = 0; i < iterations; i++)
+            call(b);
+        if (now_seconds() - start >= min_seconds / 4 || iterations >= (1L << 30))
+            break;
+        iterations *= 4;
+    }
+
+    double best = 0;
+    for (int r = 0; r < runs; r++) {
+        double start = now_seconds();
+        long calls = 0;
+        double elapsed;
+        do {
+            for (long i = 0; i < iterations; i++)
+                call(b);
+            calls += iterations;
+            elapsed = now_seconds() - start;
+        } while (elapsed < min_seconds);
+        double ns = elapsed / calls * 1e9;
+        if (r == 0 || ns < best)
+            best = ns;
+    }
+    b->ns_per_call = best;
+}
+
+static int write_report(FILE *f)
+{
+    fprintf(f, "{\n  \"benchmarks\": [\n");
+    for (int i = 0; i < NUM_BENCHES; i++) {
+        struct bench *b = &benches[i];
+        fprintf(f, "    {\"name\": \"%s\", \"ns_per_call\": %.2f, ", b->name, b->ns_per_call);
+        if (b->animation) {
+            fprintf(f, "\"pixels_per_call\": null, \"pixels_per_s\": null, ");
+        } else {
+            fprintf(f, "\"pixels_per_call\": %.0f, \"pixels_per_s\": %.0f, ", b->pixels_per_call,
+                    b->pixels_per_call / b->ns_per_call * 1e9);
+        }
+        if (b->whole_frame)
+            fprintf(f, "\"fps\": %.1f}", b->frames_per_call / b->ns_per_call * 1e9);
+        else
+            fprintf(f, "\"fps\": null}");
+        fprintf(f, "%s\n", i + 1 < NUM_BENCHES ? "," : "");
+    }
+    return fprintf(f, "  ]\n}\n") < 0 ? -1 : 0;
+}
+
+static char *read_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    size_t n = 0, cap = 4096;
+    char *text = malloc(cap);
+    size_t got;
+    while (text && (got = fread(text + n, 1, cap - n - 1, f)) > 0) {
+        n += got;
+        if (n + 1 == cap)
+            text = realloc(text, cap *= 2);
+    }
+    fclose(f);
+    if (text)
+        text[n] = '\0';
+    return text;
+}
+
+/* a number field of the object that starts at entry and ends at the next '}' */
+static int json_number(const char *entry, const char *field, double *value)
+{
+    const char *end = strchr(entry, '}');
+    char key[64];
+    snprintf(key, sizeof(key), "\"%s\":", field);
+    const char *p = strstr(entry, key);
+    if (!p || (end && p > end))
+        return 0;
+    return sscanf(p + strlen(key), " %lf", value) == 1;
+}
+
+static int compare(const char *baseline_path, double threshold)
+{
+    char *text = read_file(baseline_path);
+    if (!text) {
+        perror(baseline_path);
+        return -1;
+    }
+    int regressions = 0;
+    fprintf(stderr, "%-22s %12s %12s %8s\n", "benchmark", "baseline ns", "ns", "change");
+    for (int i = 0; i < NUM_BENCHES; i++) {
+        struct bench *b = &benches[i];
+        char key[96];
+        snprintf(key, sizeof(key), "\"name\": \"%s\"", b->name);
+        const char *entry = strstr(text, key);
+        double base, limit = threshold;
+        if (!entry || !json_number(entry, "ns_per_call", &base) || base <= 0) {
+            fprintf(stderr, "%-22s %12s %12.2f\n", b->name, "-", b->ns_per_call);
+            continue;
+        }
+        json_number(entry, "threshold", &limit);
+        double change = (b->ns_per_call / base - 1) * 100;
+        int regressed = change > limit;
+        regressions += regressed;
+        fprintf(stderr, "%-22s %12.2f %12.2f %+7.1f%%%s\n", b->name, base, b->ns_per_call, change,
+                regressed ? "  REGRESSION" : "");
+    }
+    free(text);
+    return regressions;
+}
+
+int main(int argc, char **argv)
+{
+    double min_ms = 100, threshold = 10;
+    int runs = 5;
+    const char *output = NULL, *baseline = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "-m") == 0)
+            min_ms = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+            runs = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-o") == 0)
+            output = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-b") == 0)
+            baseline = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-t") == 0)
+            threshold = atof(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-m ms] [-r runs] [-o out.json] [-b baseline.json] [-t percent]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (runs < 1)
+        runs = 1;
+
+    /* same buffer setup as main() */
+    sim_set_max_frames(UINT64_MAX);
+    present_init();
+
+    for (int i = 0; i < NUM_BENCHES; i++)
+        run(&benches[i], min_ms / 1000, runs);
+
+    FILE *f = output ? fopen(output, "w") : stdout;
+    if (!f) {
+        perror(output);
+        return 1;
+    }
+    int err = write_report(f);
+    if (output && fclose(f) != 0)
+        err = -1;
+    if (err) {
+        fprintf(stderr, "%s: write failed\n", output ? output : "stdout");
+        return 1;
+    }
+
+    if (baseline) {
+        int regressions = compare(baseline, threshold);
+        if (regressions < 0)
+            return 1;
+        if (regressions > 0) {
+            fprintf(stderr, "%d benchmark%s regressed more than the threshold\n", regressions,
+                    regressions == 1 ? "" : "s");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,352 @@
+/* Headless batch player for calibrating word difficulty.
+ *
+ * Plays complete rounds with the game's own rules (round_start, round_guess,
+ * round_won, round_lost) for every word of a dictionary under several
+ * guessing strategies, spread over all cores. Prints throughput and writes
+ * per-word statistics, plus a word list with difficulties that tools/mkdict
+ * turns back into a dictionary:
+ *
+ *   gcc -O2 -DHOST_SIM tools/calibrate.c sim/de1soc_sim.c -o calibrate -lpthread
+ *   ./calibrate -g 200 -o stats.csv -w calibrated.txt dict.bin
+ *   ./mkdict calibrated.txt calibrated.bin
+ *
+ * Options: -t threads (default: online cores), -g games per word for the
+ * randomised strategies (default 100), -s seed.
+ *
+ * Each word is one task. Workers own a contiguous range of tasks and steal
+ * the upper half of another worker's range when theirs runs out. Every task
+ * seeds its random stream from the seed and the word's index, so results
+ * don't depend on the thread count or on which worker ran the task.
+ */
+#define HANGMAN_NO_MAIN
+#include "../main.c"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+enum strategy { STRATEGY_FREQUENCY, STRATEGY_SOLVER, STRATEGY_WEIGHTED, STRATEGY_RANDOM, NUM_STRATEGIES };
+
+static const char *strategy_names[NUM_STRATEGIES] = {"frequency", "solver", "weighted", "random"};
+/* deterministic strategies play each word once */
+static const int strategy_randomised[NUM_STRATEGIES] = {0, 0, 1, 1};
+
+struct word_stats {
+    uint32_t games;
+    uint32_t wins;
+    uint32_t guesses;
+    uint32_t misses;
+};
+
+struct worker {
+    _Atomic uint64_t range;     // next task in the low 32 bits, end in the high 32 bits
+    pthread_t thread;
+    struct solver solvers[DICT_MAX_LENGTH + 1];
+    uint64_t games;
+    uint64_t steals;
+};
+
+static struct word_stats (*stats)[NUM_STRATEGIES];
+static struct worker *workers;
+static int num_workers;
+static int games_per_word = 100;
+static uint64_t seed = 1;
+
+static uint64_t pack_range(uint32_t next, uint32_t end)
+{
+    return ((uint64_t)end << 32) | next;
+}
+
+/* xorshift64*, seeded through splitmix64 */
+static uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static uint32_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (uint32_t)((x * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+/* take the next task from our own range */
+static int take_task(struct worker *self, uint32_t *task)
+{
+    uint64_t range = atomic_load(&self->range);
+    for (;;) {
+        uint32_t next = (uint32_t)range, end = (uint32_t)(range >> 32);
+        if (next >= end)
+            return 0;
+        if (atomic_compare_exchange_weak(&self->range, &range, pack_range(next + 1, end))) {
+            *task = next;
+            return 1;
+        }
+    }
+}
+
+/* move the upper half of the fullest other range into ours */
+static int steal_tasks(struct worker *self)
+{
+    for (;;) {
+        struct worker *victim = NULL;
+        uint64_t victim_range = 0;
+        uint32_t most = 0;
+        for (int i = 0; i < num_workers; i++) {
+            uint64_t range = atomic_load(&workers[i].range);
+            uint32_t left = (uint32_t)(range >> 32) - (uint32_t)range;
+            if (&workers[i] != self && (uint32_t)range < (uint32_t)(range >> 32) && left > most) {
+                most = left;
+                victim = &workers[i];
+                victim_range = range;
+            }
+        }
+        if (!victim)
+            return 0;
+        uint32_t next = (uint32_t)victim_range, end = (uint32_t)(victim_range >> 32);
+        uint32_t mid = next + (end - next) / 2;     // a single task is stolen whole
+        if (atomic_compare_exchange_strong(&victim->range, &victim_range, pack_range(next, mid))) {
+            atomic_store(&self->range, pack_range(mid, end));
+            self->steals++;
+            return 1;
+        }
+    }
+}
+
+static void count_hits(struct solver *solver, const struct round *round, int hits[26])
+{
+    solver_update(solver, round);
+    for (int letter = 0; letter < 26; letter++) {
+        hits[letter] = 0;
+        if (round->guessed & (1u << letter))
+            continue;
+        uint64_t *contains = solver_plane(solver, -1, letter);
+        for (int b = 0; b < solver->num_blocks; b++)
+            hits[letter] += __builtin_popcountll(solver->alive[b] & contains[b]);
+    }
+}
+
+static char choose_letter(int strategy, struct solver *solver, const struct round *round, uint64_t *rng)
+{
+    uint32_t open = ~round->guessed & ((1u << 26) - 1);
+    switch (strategy) {
+    case STRATEGY_FREQUENCY:
+        for (const char *c = solver_fallback_order; *c; c++)
+            if (open & letter_bit(*c))
+                return *c;
+        return 0;
+    case STRATEGY_SOLVER:
+        return solver_best_letter(solver, round);
+    case STRATEGY_WEIGHTED: {
+        /* like a player who knows the word list: letters in proportion to
+         * how many remaining words contain them */
+        int hits[26], total = 0;
+        count_hits(solver, round, hits);
+        for (int i = 0; i < 26; i++)
+            total += hits[i];
+        if (total > 0) {
+            int pick = next_random(rng) % total;
+            for (int i = 0; i < 26; i++) {
+                pick -= hits[i];
+                if (pick < 0)
+                    return 'a' + i;
+            }
+        }
+        /* no candidate left, guess at random */
+    }   /* fall through */
+    case STRATEGY_RANDOM: {
+        int n = __builtin_popcount(open);
+        if (n == 0)
+            return 0;
+        int pick = next_random(rng) % n;
+        while (pick--)
+            open &= open - 1;
+        return 'a' + __builtin_ctz(open);
+    }
+    }
+    return 0;
+}
+
+static void play_word(struct worker *self, uint32_t w)
+{
+    const char *word = dictionary_word(&dictionary, w);
+    int length = strlen(word);
+    struct solver *solver = &self->solvers[length];
+    if (solver->length != length)
+        solver_prepare(solver, length);
+    uint64_t rng = splitmix64(seed ^ splitmix64(w));
+
+    for (int strategy = 0; strategy < NUM_STRATEGIES; strategy++) {
+        struct word_stats *st = &stats[w][strategy];
+        int games = strategy_randomised[strategy] ? games_per_word : 1;
+        for (int g = 0; g < games; g++) {
+            struct round round;
+            round_start(&round, word);
+            solver_restart(solver);
+            while (!round_won(&round) && !round_lost(&round)) {
+                char letter = choose_letter(strategy, solver, &round, &rng);
+                if (!letter)
+                    break;
+                round_guess(&round, letter);
+                st->guesses++;
+            }
+            st->games++;
+            st->wins += round_won(&round);
+            st->misses += round.num_misses;
+        }
+        self->games += games;
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *self = arg;
+    uint32_t task;
+    for (;;) {
+        while (take_task(self, &task))
+            play_word(self, task);
+        if (!steal_tasks(self))
+            break;
+    }
+    return NULL;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* easiest first: the human-like strategy's win rate, then its misses */
+static int by_difficulty(const void *a, const void *b)
+{
+    const struct word_stats *x = stats[*(const uint32_t *)a] + STRATEGY_WEIGHTED;
+    const struct word_stats *y = stats[*(const uint32_t *)b] + STRATEGY_WEIGHTED;
+    uint64_t wx = (uint64_t)x->wins * y->games, wy = (uint64_t)y->wins * x->games;
+    if (wx != wy)
+        return wx > wy ? -1 : 1;
+    uint64_t mx = (uint64_t)x->misses * y->games, my = (uint64_t)y->misses * x->games;
+    if (mx != my)
+        return mx < my ? -1 : 1;
+    return *(const uint32_t *)a < *(const uint32_t *)b ? -1 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *stats_path = NULL, *words_path = NULL;
+    num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while ((opt = getopt(argc, argv, "t:g:s:o:w:")) != -1) {
+        switch (opt) {
+        case 't': num_workers = atoi(optarg); break;
+        case 'g': games_per_word = atoi(optarg); break;
+        case 's': seed = strtoull(optarg, NULL, 0); break;
+        case 'o': stats_path = optarg; break;
+        case 'w': words_path = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-g games] [-s seed] [-o stats.csv] [-w words.txt] dict.bin\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1 || num_workers < 1 || games_per_word < 1) {
+        fprintf(stderr, "usage: %s [-t threads] [-g games] [-s seed] [-o stats.csv] [-w words.txt] dict.bin\n", argv[0]);
+        return 2;
+    }
+    if (!dictionary_map_file(&dictionary, argv[optind])) {
+        fprintf(stderr, "%s: not a dictionary\n", argv[optind]);
+        return 1;
+    }
+
+    // every word is played, so check them all up front
+    uint32_t n = dictionary.header->num_words;
+    for (uint32_t w = 0; w < n; w++) {
+        if (!dictionary_word(&dictionary, w)) {
+            fprintf(stderr, "%s: word %u is corrupt\n", argv[optind], w);
+            return 1;
+        }
+    }
+    stats = calloc(n, sizeof(*stats));
+    workers = calloc(num_workers, sizeof(*workers));
+    if (!stats || !workers) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < num_workers; i++) {
+        uint32_t begin = (uint64_t)n * i / num_workers, end = (uint64_t)n * (i + 1) / num_workers;
+        atomic_init(&workers[i].range, pack_range(begin, end));
+    }
+
+    double start = now_seconds();
+    for (int i = 0; i < num_workers; i++)
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+    uint64_t games = 0, steals = 0;
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+        games += workers[i].games;
+        steals += workers[i].steals;
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("%u words, %llu games on %d threads in %.2f s: %.0f games/s, %.0f games/s per thread, %llu steals\n",
+           n, (unsigned long long)games, num_workers, elapsed, games / elapsed, games / elapsed / num_workers,
+           (unsigned long long)steals);
+    for (int s = 0; s < NUM_STRATEGIES; s++) {
+        uint64_t g = 0, wins = 0, guesses = 0;
+        for (uint32_t w = 0; w < n; w++) {
+            g += stats[w][s].games;
+            wins += stats[w][s].wins;
+            guesses += stats[w][s].guesses;
+        }
+        printf("  %-9s win rate %5.1f%%, %.2f guesses per game\n", strategy_names[s],
+               g ? 100.0 * wins / g : 0.0, g ? (double)guesses / g : 0.0);
+    }
+
+    if (stats_path) {
+        FILE *f = fopen(stats_path, "w");
+        if (!f) {
+            perror(stats_path);
+            return 1;
+        }
+        fprintf(f, "word,length");
+        for (int s = 0; s < NUM_STRATEGIES; s++)
+            fprintf(f, ",%s_win_rate,%s_guesses,%s_misses", strategy_names[s], strategy_names[s], strategy_names[s]);
+        fprintf(f, "\n");
+        for (uint32_t w = 0; w < n; w++) {
+            const char *word = dictionary_word(&dictionary, w);
+            fprintf(f, "%s,%zu", word, strlen(word));
+            for (int s = 0; s < NUM_STRATEGIES; s++) {
+                const struct word_stats *st = &stats[w][s];
+                fprintf(f, ",%.4f,%.3f,%.3f", (double)st->wins / st->games, (double)st->guesses / st->games,
+                        (double)st->misses / st->games);
+            }
+            fprintf(f, "\n");
+        }
+        fclose(f);
+    }
+
+    if (words_path) {
+        uint32_t *order = malloc(n * sizeof(uint32_t));
+        FILE *f = fopen(words_path, "w");
+        if (!order || !f) {
+            perror(words_path);
+            return 1;
+        }
+        for (uint32_t w = 0; w < n; w++)
+            order[w] = w;
+        qsort(order, n, sizeof(uint32_t), by_difficulty);
+        static const char *levels[DICT_DIFFICULTIES] = {"easy", "medium", "hard"};
+        for (uint32_t i = 0; i < n; i++)
+            fprintf(f, "%s %s\n", dictionary_word(&dictionary, order[i]), levels[(uint64_t)i * DICT_DIFFICULTIES / n]);
+        fclose(f);
+        free(order);
+    }
+    return 0;
+}
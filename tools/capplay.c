@@ -0,0 +1,237 @@
+/* Rebuilds the frames of a capture stream written by a -DCAPTURE build (see
+ * "Frame capture" in main.c). Standalone, it only reads the stream:
+ *
+ *   gcc -O2 tools/capplay.c -o capplay
+ *   ./capplay [-v] [-o prefix] [-f last.ppm] [-l socket] [stream]
+ *
+ * The stream comes from the file given, from stdin, or with -l from the
+ * first program that connects to the Unix socket at that path (run the
+ * simulator with HANGMAN_CAPTURE=unix:<path>). -o writes every frame as
+ * <prefix>NNNNNN.ppm, numbered as presented, and -f the last frame. -v
+ * prints a line per frame: its number, the milliseconds since the previous
+ * one, K for a key frame, the tiles sent and the bytes. At the end it prints
+ * the frames, key frames, frames dropped on the way, and bytes per frame.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+struct reader {
+    const uint8_t *p, *end;
+    int bad;
+};
+
+static uint32_t read_varint(struct reader *r)
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (r->p == r->end) {
+            r->bad = 1;
+            return 0;
+        }
+        uint8_t byte = *r->p++;
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+    r->bad = 1;
+    return 0;
+}
+
+static uint16_t read_u16(struct reader *r)
+{
+    if (r->end - r->p < 2) {
+        r->bad = 1;
+        return 0;
+    }
+    uint16_t value = r->p[0] | r->p[1] << 8;
+    r->p += 2;
+    return value;
+}
+
+static int read_frame_length(FILE *in, uint32_t *length)
+{
+    // 0 at the end of the stream
+    *length = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int byte = fgetc(in);
+        if (byte == EOF)
+            return shift == 0 ? 0 : -1;
+        *length |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return 1;
+    }
+    return -1;
+}
+
+static int write_ppm(const char *path, const uint16_t *pixels, int width, int height)
+{
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    fprintf(out, "P6\n%d %d\n255\n", width, height);
+    for (int i = 0; i < width * height; i++) {
+        uint16_t c = pixels[i];
+        uint8_t rgb[3] = {(c >> 11) * 255 / 31, ((c >> 5) & 0x3F) * 255 / 63, (c & 0x1F) * 255 / 31};
+        fwrite(rgb, 1, 3, out);
+    }
+    return fclose(out);
+}
+
+static FILE *listen_once(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 || bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(server, 1) < 0) {
+        perror(path);
+        return NULL;
+    }
+    int fd = accept(server, NULL, NULL);
+    close(server);
+    unlink(path);
+    if (fd < 0) {
+        perror("accept");
+        return NULL;
+    }
+    return fdopen(fd, "rb");
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-v] [-o prefix] [-f last.ppm] [-l socket] [stream]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *prefix = NULL, *last_path = NULL, *socket_path = NULL;
+    int verbose = 0, opt;
+    while ((opt = getopt(argc, argv, "vo:f:l:")) != -1) {
+        switch (opt) {
+        case 'v': verbose = 1; break;
+        case 'o': prefix = optarg; break;
+        case 'f': last_path = optarg; break;
+        case 'l': socket_path = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind < argc - 1 || (socket_path && optind < argc))
+        usage(argv[0]);
+
+    FILE *in = stdin;
+    if (socket_path)
+        in = listen_once(socket_path);
+    else if (optind < argc)
+        in = fopen(argv[optind], "rb");
+    if (!in) {
+        if (!socket_path)
+            perror(argv[optind]);
+        return 1;
+    }
+
+    uint8_t header[10];
+    if (fread(header, 1, sizeof(header), in) != sizeof(header) || memcmp(header, "HGCS", 4) != 0 || header[4] != 1) {
+        fprintf(stderr, "not a capture stream\n");
+        return 1;
+    }
+    int width = header[5] | header[6] << 8;
+    int height = header[7] | header[8] << 8;
+    int tile = header[9];
+    if (tile == 0 || width % tile || height % tile) {
+        fprintf(stderr, "bad stream header\n");
+        return 1;
+    }
+    int tiles_x = width / tile, tiles = tiles_x * (height / tile);
+    uint16_t *pixels = calloc((size_t)width * height, sizeof(uint16_t));
+    uint8_t *frame = NULL;
+    size_t frame_capacity = 0;
+
+    uint64_t frames = 0, keys = 0, dropped = 0, bytes = sizeof(header), tiles_sent = 0;
+    int64_t expected = 0;
+    uint32_t length;
+    int status;
+    while ((status = read_frame_length(in, &length)) > 0) {
+        if (length > frame_capacity) {
+            frame_capacity = length;
+            frame = realloc(frame, frame_capacity);
+        }
+        if (!frame || fread(frame, 1, length, in) != length) {
+            status = -1;
+            break;
+        }
+        bytes += length + 1 + (length >= 0x80) + (length >= 0x4000) + (length >= 0x200000);
+        struct reader r = {frame, frame + length, 0};
+        uint32_t number = read_varint(&r);
+        uint32_t ms = read_varint(&r);
+        int key = r.p < r.end ? *r.p++ & 1 : (r.bad = 1, 0);
+        const uint8_t *bitmap = r.p;
+        r.p += (tiles + 7) / 8;
+        if (r.p > r.end) {
+            status = -1;
+            break;
+        }
+        if (key) {
+            memset(pixels, 0, (size_t)width * height * sizeof(uint16_t));
+            keys++;
+        } else if (frames == 0) {
+            fprintf(stderr, "stream starts without a key frame\n");
+            return 1;
+        }
+        dropped += number > expected ? number - expected : 0;
+        expected = (int64_t)number + 1;
+
+        int sent = 0;
+        for (int t = 0; t < tiles && !r.bad; t++) {
+            if (!(bitmap[t >> 3] & (1 << (t & 7))))
+                continue;
+            sent++;
+            uint16_t *origin = pixels + (t / tiles_x * tile) * width + t % tiles_x * tile;
+            for (int i = 0; i < tile * tile && !r.bad; ) {
+                uint32_t run = read_varint(&r);
+                uint32_t count = run >> 1;
+                uint16_t value = (run & 1) ? read_u16(&r) : 0;
+                if (count == 0 || count > (uint32_t)(tile * tile - i)) {
+                    r.bad = 1;
+                    break;
+                }
+                for (; count > 0; count--, i++) {
+                    uint16_t delta = (run & 1) ? value : read_u16(&r);
+                    origin[i / tile * width + i % tile] ^= delta;
+                }
+            }
+        }
+        if (r.bad || r.p != r.end) {
+            fprintf(stderr, "frame %u is corrupt\n", number);
+            return 1;
+        }
+        frames++;
+        tiles_sent += sent;
+        if (verbose)
+            printf("%6u %4u ms %c %3d tiles %7u bytes\n", number, ms, key ? 'K' : ' ', sent, length);
+        if (prefix) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s%06u.ppm", prefix, number);
+            if (write_ppm(path, pixels, width, height) != 0)
+                return 1;
+        }
+    }
+    if (status < 0) {
+        fprintf(stderr, "stream ends in the middle of a frame\n");
+        return 1;
+    }
+    if (last_path && frames && write_ppm(last_path, pixels, width, height) != 0)
+        return 1;
+    printf("%llu frames (%llu key, %llu dropped), %llu bytes, %.0f bytes/frame, %.1f tiles/frame of %d\n",
+           (unsigned long long)frames, (unsigned long long)keys, (unsigned long long)dropped,
+           (unsigned long long)bytes, frames ? (double)bytes / frames : 0.0,
+           frames ? (double)tiles_sent / frames : 0.0, tiles);
+    return 0;
+}
@@ -0,0 +1,271 @@
+/* Load generator for tools/server.c. Standalone, it only speaks the
+ * protocol:
+ *
+ *   gcc -O2 -pthread tools/loadgen.c -o hangman-loadgen
+ *   ./hangman-loadgen [-t threads] [-c connections] [-d seconds] [-p port | -u path] [-l difficulty]
+ *
+ * Each thread (default 4) opens -c (default 64) connections and keeps one
+ * request in flight on each: it starts a round at difficulty -l (default 2),
+ * guesses letters in English frequency order until the round is won or
+ * lost, then sends "restart" and "new" together and starts over. The time
+ * from sending a request to reading its last reply line is recorded in a
+ * histogram of 1 us buckets. After -d (default 10) seconds it prints the
+ * rounds finished and guesses answered per second, and the mean, median,
+ * 99th percentile and worst latency.
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LATENCY_BUCKETS 100000      // 1 us each, the last one holds everything slower
+#define MAX_EVENTS 256
+
+static const char guess_order[] = "etaoinshrdlcumwfgypbvkjxqz";
+
+struct connection {
+    int fd;
+    int next_guess;         // index into guess_order
+    int replies_due;        // reply lines still expected for the request in flight
+    uint64_t sent_ns;
+    int in_used;
+    char in[256];
+};
+
+struct client {
+    pthread_t thread;
+    int connections;
+    uint64_t rounds;
+    uint64_t guesses;
+    uint64_t errors;
+    uint64_t latency[LATENCY_BUCKETS];
+};
+
+static int num_threads = 4;
+static int connections_per_thread = 64;
+static int seconds = 10;
+static int port = 7243;
+static const char *unix_path;
+static int difficulty = 2;
+static volatile int stopping;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int connect_server(void)
+{
+    int fd;
+    if (unix_path) {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        strncpy(addr.sun_path, unix_path, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+            return -1;
+    } else {
+        struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port)};
+        int one = 1;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+            return -1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static void send_request(struct connection *c, const char *request, int replies)
+{
+    // requests are short enough that the socket buffer always takes them whole
+    c->replies_due = replies;
+    c->sent_ns = now_ns();
+    if (write(c->fd, request, strlen(request)) < 0)
+        perror("write");
+}
+
+static void send_guess(struct connection *c)
+{
+    char request[] = "guess ?\n";
+    request[6] = guess_order[c->next_guess++];
+    send_request(c, request, 1);
+}
+
+static void new_round(struct connection *c, int restart)
+{
+    char request[32];
+    snprintf(request, sizeof(request), "%snew %d\n", restart ? "restart\n" : "", difficulty);
+    c->next_guess = 0;
+    send_request(c, request, restart ? 2 : 1);
+}
+
+static void handle_reply(struct client *cl, struct connection *c, const char *line)
+{
+    if (--c->replies_due > 0)
+        return;     // "menu", the "play" line is next
+    uint64_t us = (now_ns() - c->sent_ns) / 1000;
+    cl->latency[us < LATENCY_BUCKETS ? us : LATENCY_BUCKETS - 1]++;
+    if (!strncmp(line, "won ", 4) || !strncmp(line, "lost ", 5)) {
+        cl->guesses++;
+        cl->rounds++;
+        new_round(c, 1);
+    } else if (!strncmp(line, "play ", 5) || !strncmp(line, "hit ", 4) || !strncmp(line, "miss ", 5)
+               || !strncmp(line, "repeat ", 7)) {
+        if (line[0] != 'p')
+            cl->guesses++;
+        if (c->next_guess < (int)sizeof(guess_order) - 1)
+            send_guess(c);
+        else
+            new_round(c, 1);
+    } else {
+        cl->errors++;
+        new_round(c, 1);
+    }
+}
+
+static void *client_main(void *arg)
+{
+    struct client *cl = arg;
+    struct connection *conns = calloc(cl->connections, sizeof(struct connection));
+    struct epoll_event events[MAX_EVENTS];
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (!conns || epoll < 0)
+        return NULL;
+    for (int i = 0; i < cl->connections; i++) {
+        struct connection *c = &conns[i];
+        c->fd = connect_server();
+        if (c->fd < 0) {
+            perror("connect");
+            exit(1);
+        }
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = c};
+        epoll_ctl(epoll, EPOLL_CTL_ADD, c->fd, &event);
+        new_round(c, 0);
+    }
+    while (!stopping) {
+        int n = epoll_wait(epoll, events, MAX_EVENTS, 100);
+        for (int i = 0; i < n; i++) {
+            struct connection *c = events[i].data.ptr;
+            ssize_t got = read(c->fd, c->in + c->in_used, sizeof(c->in) - c->in_used);
+            if (got <= 0) {
+                if (got < 0 && errno == EAGAIN)
+                    continue;
+                fprintf(stderr, "server closed the connection\n");
+                exit(1);
+            }
+            c->in_used += got;
+            char *line = c->in, *end = c->in + c->in_used, *newline;
+            while ((newline = memchr(line, '\n', end - line))) {
+                *newline = '\0';
+                handle_reply(cl, c, line);
+                line = newline + 1;
+            }
+            c->in_used = end - line;
+            memmove(c->in, line, c->in_used);
+        }
+    }
+    for (int i = 0; i < cl->connections; i++)
+        close(conns[i].fd);
+    free(conns);
+    close(epoll);
+    return NULL;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t threads] [-c connections] [-d seconds] [-p port | -u path] [-l difficulty]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "t:c:d:p:u:l:")) != -1) {
+        switch (opt) {
+        case 't': num_threads = atoi(optarg); break;
+        case 'c': connections_per_thread = atoi(optarg); break;
+        case 'd': seconds = atoi(optarg); break;
+        case 'p': port = atoi(optarg); break;
+        case 'u': unix_path = optarg; break;
+        case 'l': difficulty = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || num_threads < 1 || connections_per_thread < 1 || seconds < 1
+        || difficulty < 1 || difficulty > 3)
+        usage(argv[0]);
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    struct client *clients = calloc(num_threads, sizeof(struct client));
+    if (!clients) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    uint64_t start = now_ns();
+    for (int i = 0; i < num_threads; i++) {
+        clients[i].connections = connections_per_thread;
+        pthread_create(&clients[i].thread, NULL, client_main, &clients[i]);
+    }
+    sleep(seconds);
+    stopping = 1;
+    double elapsed = (now_ns() - start) / 1e9;
+
+    uint64_t rounds = 0, guesses = 0, errors = 0, replies = 0;
+    static uint64_t latency[LATENCY_BUCKETS];
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(clients[i].thread, NULL);
+        rounds += clients[i].rounds;
+        guesses += clients[i].guesses;
+        errors += clients[i].errors;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            latency[b] += clients[i].latency[b];
+            replies += clients[i].latency[b];
+        }
+    }
+    if (!replies) {
+        fprintf(stderr, "no replies\n");
+        return 1;
+    }
+    double sum = 0;
+    int p50 = -1, p99 = -1, worst = 0;
+    uint64_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        if (!latency[b])
+            continue;
+        sum += (double)b * latency[b];
+        seen += latency[b];
+        if (p50 < 0 && seen * 2 >= replies)
+            p50 = b;
+        if (p99 < 0 && seen * 100 >= replies * 99)
+            p99 = b;
+        worst = b;
+    }
+    printf("%d threads x %d connections, %.1f s\n", num_threads, connections_per_thread, elapsed);
+    printf("%12.0f sessions/s (rounds finished)\n", rounds / elapsed);
+    printf("%12.0f guesses/s\n", guesses / elapsed);
+    printf("%12.0f requests/s\n", replies / elapsed);
+    printf("latency: mean %.1f us, p50 %d us, p99 %d us, max %s%d us\n", sum / replies, p50, p99,
+           worst == LATENCY_BUCKETS - 1 ? ">= " : "", worst);
+    if (errors)
+        printf("%llu error replies\n", (unsigned long long)errors);
+    return 0;
+}
@@ -0,0 +1,258 @@
+/* Builds the binary dictionary read by dictionary_open() from a word list.
+ *
+ *   gcc -O2 -DHOST_SIM tools/mkdict.c sim/de1soc_sim.c -o mkdict
+ *   ./mkdict words.txt dict.bin          binary file, for HANGMAN_DICT
+ *   ./mkdict -c words.txt dict_blob.h    C array, for -DDICTIONARY_BLOB='"dict_blob.h"'
+ *
+ * The word list has one word per line. Words are lowercased; words with
+ * characters other than letters, or longer than DICT_MAX_LENGTH, are
+ * skipped, as are later copies of a word. A line may give the difficulty
+ * after the word (0-2 or easy/medium/hard), as written by tools/calibrate;
+ * any other label is an error. Without one the difficulty is
+ * computed: the word is played against a guesser that tries letters in
+ * English frequency order, and the words are split into thirds by the
+ * misses it takes, with more misses meaning harder.
+ */
+#define HANGMAN_NO_MAIN
+#include "../main.c"
+
+#include <errno.h>
+
+struct entry {
+    char word[DICT_MAX_LENGTH + 1];
+    int length;
+    int difficulty;     // -1 until assigned
+    int misses;
+    int line;           // in the word list, to keep the first of duplicates
+};
+
+static int frequency_misses(const char *word)
+{
+    uint32_t letters = 0, guessed = 0;
+    int misses = 0;
+    for (const char *c = word; *c; c++)
+        letters |= letter_bit(*c);
+    for (const char *c = solver_fallback_order; (letters & ~guessed) != 0; c++) {
+        guessed |= letter_bit(*c);
+        if (!(letters & letter_bit(*c)))
+            misses++;
+    }
+    return misses;
+}
+
+static int parse_difficulty(const char *s)
+{
+    if (strcmp(s, "0") == 0 || strcmp(s, "easy") == 0)
+        return EASY;
+    if (strcmp(s, "1") == 0 || strcmp(s, "medium") == 0)
+        return MEDIUM;
+    if (strcmp(s, "2") == 0 || strcmp(s, "hard") == 0)
+        return HARD;
+    return -1;
+}
+
+static int by_word(const void *a, const void *b)
+{
+    const struct entry *x = a, *y = b;
+    int order = strcmp(x->word, y->word);
+    return order != 0 ? order : x->line - y->line;
+}
+
+/* easiest first: fewer misses, then longer words */
+static int by_misses(const void *a, const void *b)
+{
+    const struct entry *x = a, *y = b;
+    if (x->misses != y->misses)
+        return x->misses - y->misses;
+    if (x->length != y->length)
+        return y->length - x->length;
+    return strcmp(x->word, y->word);
+}
+
+static int by_bucket(const void *a, const void *b)
+{
+    const struct entry *x = a, *y = b;
+    if (x->difficulty != y->difficulty)
+        return x->difficulty - y->difficulty;
+    if (x->length != y->length)
+        return x->length - y->length;
+    return strcmp(x->word, y->word);
+}
+
+static struct entry *read_words(const char *path, size_t *count)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    size_t n = 0, cap = 1024;
+    struct entry *entries = malloc(cap * sizeof(*entries));
+    char line[256];
+    int line_number = 0;
+    while (entries && fgets(line, sizeof(line), f)) {
+        line_number++;
+        char word[sizeof(line)], level[sizeof(line)];
+        int fields = sscanf(line, "%255s %255s", word, level);
+        if (fields < 1)
+            continue;
+        int length = 0;
+        for (char *c = word; *c; c++, length++) {
+            *c = tolower((unsigned char)*c);
+            if (*c < 'a' || *c > 'z')
+                break;
+        }
+        if (word[length] != '\0' || length > DICT_MAX_LENGTH)
+            continue;
+        int difficulty = fields == 2 ? parse_difficulty(level) : -1;
+        if (fields == 2 && difficulty < 0) {
+            fprintf(stderr, "%s:%d: unknown difficulty \"%s\"\n", path, line_number, level);
+            exit(1);
+        }
+        if (n == cap) {
+            cap *= 2;
+            entries = realloc(entries, cap * sizeof(*entries));
+            if (!entries)
+                break;
+        }
+        struct entry *e = &entries[n++];
+        memcpy(e->word, word, length + 1);
+        e->length = length;
+        e->difficulty = difficulty;
+        e->misses = frequency_misses(word);
+        e->line = line_number;
+    }
+    fclose(f);
+    if (!entries) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    /* drop duplicates, keeping the first */
+    qsort(entries, n, sizeof(*entries), by_word);
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (kept == 0 || strcmp(entries[kept - 1].word, entries[i].word) != 0)
+            entries[kept++] = entries[i];
+    }
+    *count = kept;
+    return entries;
+}
+
+static void assign_difficulties(struct entry *entries, size_t n)
+{
+    qsort(entries, n, sizeof(*entries), by_misses);
+    size_t unassigned = 0;
+    for (size_t i = 0; i < n; i++)
+        unassigned += entries[i].difficulty < 0;
+    size_t rank = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (entries[i].difficulty >= 0)
+            continue;
+        entries[i].difficulty = (int)(rank * DICT_DIFFICULTIES / unassigned);
+        rank++;
+    }
+}
+
+static void *build_blob(struct entry *entries, size_t n, uint32_t *size)
+{
+    qsort(entries, n, sizeof(*entries), by_bucket);
+
+    uint32_t num_buckets = DICT_DIFFICULTIES * (DICT_MAX_LENGTH + 1);
+    uint32_t strings_size = 0;
+    for (size_t i = 0; i < n; i++)
+        strings_size += entries[i].length + 1;
+
+    struct dict_header header = {0};
+    header.magic = DICT_MAGIC;
+    header.version = DICT_VERSION;
+    header.num_words = n;
+    header.buckets_offset = sizeof(header);
+    header.index_offset = header.buckets_offset + num_buckets * sizeof(struct dict_bucket);
+    header.strings_offset = header.index_offset + n * sizeof(uint32_t);
+    header.total_size = (header.strings_offset + strings_size + 3) & ~3u;
+
+    char *blob = calloc(1, header.total_size);
+    if (!blob) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    memcpy(blob, &header, sizeof(header));
+    struct dict_bucket *buckets = (struct dict_bucket *)(blob + header.buckets_offset);
+    uint32_t *index = (uint32_t *)(blob + header.index_offset);
+    char *strings = blob + header.strings_offset;
+
+    /* empty buckets still get the start position, so ranges stay contiguous */
+    uint32_t offset = 0;
+    size_t i = 0;
+    for (uint32_t b = 0; b < num_buckets; b++) {
+        int difficulty = b / (DICT_MAX_LENGTH + 1);
+        int length = b % (DICT_MAX_LENGTH + 1);
+        buckets[b].first = i;
+        while (i < n && entries[i].difficulty == difficulty && entries[i].length == length) {
+            index[i] = offset;
+            memcpy(strings + offset, entries[i].word, entries[i].length + 1);
+            offset += entries[i].length + 1;
+            i++;
+        }
+        buckets[b].count = i - buckets[b].first;
+    }
+    *size = header.total_size;
+    return blob;
+}
+
+static int write_c_array(FILE *f, const unsigned char *blob, uint32_t size)
+{
+    fprintf(f, "/* Generated by tools/mkdict, do not edit. */\n");
+    fprintf(f, "static const unsigned char dictionary_blob[%u] __attribute__((aligned(4))) = {", size);
+    for (uint32_t i = 0; i < size; i++)
+        fprintf(f, "%s0x%02x,", i % 16 ? " " : "\n    ", blob[i]);
+    return fprintf(f, "\n};\n") < 0 ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int c_array = argc > 1 && strcmp(argv[1], "-c") == 0;
+    if (argc != 3 + c_array) {
+        fprintf(stderr, "usage: %s [-c] words.txt output\n", argv[0]);
+        return 2;
+    }
+    const char *input = argv[1 + c_array];
+    const char *output = argv[2 + c_array];
+
+    size_t n;
+    struct entry *entries = read_words(input, &n);
+    assign_difficulties(entries, n);
+    uint32_t size;
+    unsigned char *blob = build_blob(entries, n, &size);
+
+    FILE *f = fopen(output, c_array ? "w" : "wb");
+    if (!f) {
+        perror(output);
+        return 1;
+    }
+    int err = c_array ? write_c_array(f, blob, size) : (fwrite(blob, 1, size, f) == size ? 0 : -1);
+    if (fclose(f) != 0 || err) {
+        fprintf(stderr, "%s: %s\n", output, strerror(errno));
+        return 1;
+    }
+
+    struct dictionary dict;
+    int sound = dictionary_open(&dict, blob, size);
+    for (uint32_t w = 0; sound && w < dict.header->num_words; w++)
+        sound = dictionary_word(&dict, w) != NULL;
+    if (!sound) {
+        fprintf(stderr, "internal error: generated dictionary does not open\n");
+        return 1;
+    }
+    printf("%zu words, %u bytes\n", n, size);
+    for (int d = 0; d < DICT_DIFFICULTIES; d++) {
+        const struct dict_bucket *first = dictionary_bucket(&dict, d, 0);
+        const struct dict_bucket *last = dictionary_bucket(&dict, d, DICT_MAX_LENGTH);
+        printf("  %-6s %u words\n", d == EASY ? "easy" : d == MEDIUM ? "medium" : "hard",
+               last->first + last->count - first->first);
+    }
+    free(blob);
+    free(entries);
+    return 0;
+}
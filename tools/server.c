@@ -0,0 +1,469 @@
+/* Hangman over a socket, for throughput testing on the host. Every
+ * connection is a session that plays the game the way main() does: a menu
+ * (state 0), a round (1), lost (2) and won (3), with the same rules
+ * (round_start, round_guess, round_won, round_lost) and word choice:
+ *
+ *   gcc -O2 -DHOST_SIM -pthread tools/server.c sim/de1soc_sim.c -o hangman-server
+ *   ./hangman-server [-t threads] [-p port | -u path] [-c sessions] [-d seconds] [dict.bin]
+ *
+ * The protocol is one line per request and one line per reply:
+ *   new <easy|medium|hard|1|2|3>  in the menu, start a round  -> play <pattern> <health>
+ *   guess <letter>                in a round                  -> hit|miss|repeat <pattern> <health>,
+ *                                                                 won <word> or lost <word>
+ *   restart                       like KEY0, back to the menu -> menu
+ *   quit                                                      -> bye, and the connection is closed
+ * Anything else, or a request in the wrong state, gets "error <reason>".
+ * The pattern has the word's letters that were guessed and '_' for the rest.
+ *
+ * Each thread (default: one per online core, pinned to it) runs its own
+ * epoll loop. Over TCP (127.0.0.1, default port 7243) every thread has its
+ * own listening socket on the same port with SO_REUSEPORT, so the kernel
+ * spreads connections over them. A Unix socket (-u) can't be shared that
+ * way, so the threads wait on one listening socket with EPOLLEXCLUSIVE.
+ * Sessions come from a slab of -c (default 16384) per thread allocated at
+ * startup, with fixed line buffers, so serving a request allocates nothing;
+ * connections beyond that are closed at once. The dictionary is mapped once
+ * and read by every thread. The server stops after -d seconds, or on
+ * SIGINT or SIGTERM, and prints what it served.
+ */
+#define _GNU_SOURCE
+#define HANGMAN_NO_MAIN
+#include "../main.c"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+
+#define SESSION_IN 128          // longest request line
+#define SESSION_OUT 1024        // replies waiting to be sent
+#define MAX_REPLY 64            // longest reply line
+#define MAX_EVENTS 256
+
+enum session_state { STATE_MENU, STATE_PLAYING, STATE_LOST, STATE_WON };
+
+struct session {
+    int fd;
+    int state;                  // game_state in main()
+    struct round round;
+    uint32_t random;
+    int closing;                // close once the replies are sent
+    int in_used;
+    int out_used, out_sent;
+    char in[SESSION_IN];
+    char out[SESSION_OUT];
+    struct session *next_free;
+};
+
+struct server_stats {
+    uint64_t connections;
+    uint64_t rejected;
+    uint64_t rounds;
+    uint64_t guesses;
+    uint64_t won;
+    uint64_t lost;
+};
+
+struct worker {
+    int index;
+    int epoll;
+    int listener;
+    pthread_t thread;
+    struct session *slab;
+    struct session *free;
+    uint32_t random;
+    struct server_stats stats;
+};
+
+static volatile sig_atomic_t stopping;
+static int num_workers;
+static int sessions_per_worker = 16384;
+static int port = 7243;
+static const char *unix_path;
+static int shared_listener = -1;
+
+static void stop(int signal)
+{
+    (void)signal;
+    stopping = 1;
+}
+
+static uint32_t xorshift(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* Replies. Each is appended whole to the output buffer; requests are only
+ * read while there is room for one more. */
+static void reply(struct session *s, const char *text)
+{
+    size_t n = strlen(text);
+    memcpy(s->out + s->out_used, text, n);
+    s->out_used += n;
+}
+
+static void reply_round(struct session *s, const char *verb)
+{
+    char *p = s->out + s->out_used;
+    size_t n = strlen(verb);
+    memcpy(p, verb, n);
+    p += n;
+    *p++ = ' ';
+    for (int i = 0; i < s->round.length; i++) {
+        char c = s->round.word[i];
+        *p++ = (s->round.revealed & letter_bit(c)) ? c : '_';
+    }
+    *p++ = ' ';
+    *p++ = '0' + s->round.health;
+    *p++ = '\n';
+    s->out_used = p - s->out;
+}
+
+static void reply_word(struct session *s, const char *verb)
+{
+    reply(s, verb);
+    reply(s, s->round.word);
+    reply(s, "\n");
+}
+
+static int parse_difficulty(const char *arg)
+{
+    if (!strcmp(arg, "easy") || !strcmp(arg, "1"))
+        return EASY;
+    if (!strcmp(arg, "medium") || !strcmp(arg, "2"))
+        return MEDIUM;
+    if (!strcmp(arg, "hard") || !strcmp(arg, "3"))
+        return HARD;
+    return -1;
+}
+
+static void handle_line(struct worker *w, struct session *s, char *line)
+{
+    char *arg = strchr(line, ' ');
+    if (arg)
+        *arg++ = '\0';
+    else
+        arg = line + strlen(line);
+
+    if (!strcmp(line, "new")) {
+        int difficulty = parse_difficulty(arg);
+        if (s->state != STATE_MENU) {
+            reply(s, "error not in the menu\n");
+        } else if (difficulty < 0) {
+            reply(s, "error unknown difficulty\n");
+        } else {
+            round_start(&s->round, pick_word(difficulty, xorshift(&s->random)));
+            s->state = STATE_PLAYING;
+            w->stats.rounds++;
+            reply_round(s, "play");
+        }
+    } else if (!strcmp(line, "guess")) {
+        if (s->state != STATE_PLAYING) {
+            reply(s, "error no round\n");
+            return;
+        }
+        enum guess_result result = round_guess(&s->round, arg[0] && !arg[1] ? tolower((unsigned char)arg[0]) : 0);
+        if (result == GUESS_INVALID) {
+            reply(s, "error not a letter\n");
+            return;
+        }
+        w->stats.guesses++;
+        if (round_won(&s->round)) {
+            s->state = STATE_WON;
+            w->stats.won++;
+            reply_word(s, "won ");
+        } else if (round_lost(&s->round)) {
+            s->state = STATE_LOST;
+            w->stats.lost++;
+            reply_word(s, "lost ");
+        } else {
+            reply_round(s, result == GUESS_HIT ? "hit" : result == GUESS_MISS ? "miss" : "repeat");
+        }
+    } else if (!strcmp(line, "restart")) {
+        s->state = STATE_MENU;
+        reply(s, "menu\n");
+    } else if (!strcmp(line, "quit")) {
+        reply(s, "bye\n");
+        s->closing = TRUE;
+    } else {
+        reply(s, "error unknown command\n");
+    }
+}
+
+static void session_close(struct worker *w, struct session *s)
+{
+    close(s->fd);       // also leaves the epoll set
+    s->next_free = w->free;
+    w->free = s;
+}
+
+static void session_watch(struct worker *w, struct session *s, int op)
+{
+    // while replies are waiting, wait for room to send them instead of reading
+    struct epoll_event event = {.events = s->out_sent < s->out_used ? EPOLLOUT : EPOLLIN, .data.ptr = s};
+    epoll_ctl(w->epoll, op, s->fd, &event);
+}
+
+static void session_accept(struct worker *w)
+{
+    for (;;) {
+        int fd = accept4(w->listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;     // EAGAIN, or another thread took it
+        struct session *s = w->free;
+        if (!s) {
+            close(fd);
+            w->stats.rejected++;
+            continue;
+        }
+        w->free = s->next_free;
+        if (!unix_path) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        s->fd = fd;
+        s->state = STATE_MENU;
+        s->random = xorshift(&w->random);
+        s->closing = FALSE;
+        s->in_used = s->out_used = s->out_sent = 0;
+        w->stats.connections++;
+        session_watch(w, s, EPOLL_CTL_ADD);
+    }
+}
+
+static int session_flush(struct session *s)
+{
+    // send what we can; FALSE if the connection is gone
+    while (s->out_sent < s->out_used) {
+        ssize_t n = write(s->fd, s->out + s->out_sent, s->out_used - s->out_sent);
+        if (n < 0)
+            return errno == EAGAIN || errno == EINTR;
+        s->out_sent += n;
+    }
+    s->out_used = s->out_sent = 0;
+    return TRUE;
+}
+
+static int session_process(struct worker *w, struct session *s)
+{
+    // handle the complete lines received; FALSE to close the connection
+    char *line = s->in, *end = s->in + s->in_used, *newline;
+    while (!s->closing && s->out_used + MAX_REPLY <= SESSION_OUT && (newline = memchr(line, '\n', end - line))) {
+        *newline = '\0';
+        if (newline > line && newline[-1] == '\r')
+            newline[-1] = '\0';
+        handle_line(w, s, line);
+        line = newline + 1;
+    }
+    s->in_used = end - line;
+    memmove(s->in, line, s->in_used);
+    if (s->in_used == SESSION_IN && !memchr(s->in, '\n', SESSION_IN))
+        return FALSE;       // a line too long for the buffer
+    return TRUE;
+}
+
+static int session_serve(struct worker *w, struct session *s)
+{
+    // Answer buffered lines and send the replies, again as long as sending
+    // makes room for more, until the socket is full or no complete line is
+    // left; FALSE to close the connection
+    for (;;) {
+        int before = s->in_used;
+        if (!session_process(w, s) || !session_flush(s))
+            return FALSE;
+        if (s->closing || s->out_sent < s->out_used || s->in_used == before)
+            return TRUE;
+    }
+}
+
+static void session_event(struct worker *w, struct session *s, uint32_t events)
+{
+    int was_waiting = s->out_sent < s->out_used;
+    int ok = !(events & (EPOLLERR | EPOLLHUP)) || (events & EPOLLIN);
+    if (ok && (events & EPOLLOUT))
+        ok = session_serve(w, s);       // and the lines held back while the buffer was full
+    if (ok && (events & EPOLLIN) && s->in_used < SESSION_IN) {
+        ssize_t n = read(s->fd, s->in + s->in_used, SESSION_IN - s->in_used);
+        if (n > 0) {
+            s->in_used += n;
+            ok = session_serve(w, s);
+        } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+            ok = FALSE;
+        }
+    }
+    if (!ok || (s->closing && s->out_sent == s->out_used)) {
+        session_close(w, s);
+        return;
+    }
+    if (was_waiting != (s->out_sent < s->out_used))
+        session_watch(w, s, EPOLL_CTL_MOD);
+}
+
+static int open_listener(void)
+{
+    int fd, one = 1;
+    if (unix_path) {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        strncpy(addr.sun_path, unix_path, sizeof(addr.sun_path) - 1);
+        unlink(unix_path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+            perror(unix_path);
+            exit(1);
+        }
+        return fd;
+    }
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port)};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0
+        || setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0
+        || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        perror("listen");
+        exit(1);
+    }
+    return fd;
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event listen_event = {.events = EPOLLIN | (unix_path ? EPOLLEXCLUSIVE : 0), .data.ptr = NULL};
+    epoll_ctl(w->epoll, EPOLL_CTL_ADD, w->listener, &listen_event);
+    while (!stopping) {
+        int n = epoll_wait(w->epoll, events, MAX_EVENTS, 100);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL)
+                session_accept(w);
+            else
+                session_event(w, events[i].data.ptr, events[i].events);
+        }
+    }
+    return NULL;
+}
+
+static int worker_init(struct worker *w, int index)
+{
+    w->index = index;
+    w->random = 0x2545F491u + index * 0x9E3779B9u;
+    w->slab = calloc(sessions_per_worker, sizeof(struct session));
+    w->epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (!w->slab || w->epoll < 0)
+        return FALSE;
+    for (int i = sessions_per_worker - 1; i >= 0; i--) {
+        w->slab[i].next_free = w->free;
+        w->free = &w->slab[i];
+    }
+    w->listener = unix_path ? shared_listener : open_listener();
+    return TRUE;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t threads] [-p port | -u path] [-c sessions] [-d seconds] [dict.bin]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = 0, opt;
+    num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "t:p:u:c:d:")) != -1) {
+        switch (opt) {
+        case 't': num_workers = atoi(optarg); break;
+        case 'p': port = atoi(optarg); break;
+        case 'u': unix_path = optarg; break;
+        case 'c': sessions_per_worker = atoi(optarg); break;
+        case 'd': seconds = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind < argc - 1 || num_workers < 1 || sessions_per_worker < 1)
+        usage(argv[0]);
+    if (optind == argc - 1 && !dictionary_map_file(&dictionary, argv[optind])) {
+        fprintf(stderr, "%s: not a dictionary\n", argv[optind]);
+        return 1;
+    }
+
+    // one descriptor per session, plus the listeners and epolls
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    if (unix_path)
+        shared_listener = open_listener();
+    struct worker *workers = calloc(num_workers, sizeof(struct worker));
+    if (!workers) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    // the CPUs this process may run on, which need not be 0..n-1
+    cpu_set_t allowed;
+    int cpus[CPU_SETSIZE], num_cpus = 0;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed))
+                cpus[num_cpus++] = cpu;
+        }
+    }
+    for (int i = 0; i < num_workers; i++) {
+        if (!worker_init(&workers[i], i)) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+        if (num_workers <= num_cpus) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i], &set);
+            pthread_setaffinity_np(workers[i].thread, sizeof(set), &set);
+        }
+    }
+    if (unix_path)
+        fprintf(stderr, "serving on %s with %d threads\n", unix_path, num_workers);
+    else
+        fprintf(stderr, "serving on 127.0.0.1:%d with %d threads\n", port, num_workers);
+    for (int elapsed = 0; !stopping && (seconds == 0 || elapsed < seconds * 10); elapsed++) {
+        struct timespec tick = {0, 100000000};
+        nanosleep(&tick, NULL);
+    }
+    stopping = 1;
+
+    struct server_stats total = {0};
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+        struct server_stats *st = &workers[i].stats;
+        printf("thread %d: %llu connections, %llu rounds, %llu guesses\n", i, (unsigned long long)st->connections,
+               (unsigned long long)st->rounds, (unsigned long long)st->guesses);
+        total.connections += st->connections;
+        total.rejected += st->rejected;
+        total.rounds += st->rounds;
+        total.guesses += st->guesses;
+        total.won += st->won;
+        total.lost += st->lost;
+    }
+    printf("total: %llu connections (%llu rejected), %llu rounds (%llu won, %llu lost), %llu guesses\n",
+           (unsigned long long)total.connections, (unsigned long long)total.rejected, (unsigned long long)total.rounds,
+           (unsigned long long)total.won, (unsigned long long)total.lost, (unsigned long long)total.guesses);
+    if (unix_path)
+        unlink(unix_path);
+    return 0;
+}
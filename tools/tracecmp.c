@@ -0,0 +1,150 @@
+/* Compares two per-frame traces written with HANGMAN_SIM_TRACE, usually a
+ * baseline and a new build replaying the same input log:
+ *
+ *   HANGMAN_SIM_REPLAY=game.log HANGMAN_SIM_TRACE=new.trace ./hangman-sim
+ *   gcc -O2 tools/tracecmp.c -o tracecmp
+ *   ./tracecmp [-t percent] base.trace new.trace
+ *
+ * The screen hashes are compared frame by frame and the first frame that
+ * differs is reported. Frame times are summarised for both traces as mean,
+ * median, 99th percentile and maximum. The exit status is 1 if a hash
+ * differs or the traces have different lengths, or, with -t, if the median
+ * frame time is more than that many percent above the baseline. Unlike the
+ * other tools it doesn't use the game, so it builds on its own.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+struct trace {
+    size_t count;
+    uint64_t *frames;
+    uint64_t *hashes;
+    uint64_t *ns;
+};
+
+static int read_trace(const char *path, struct trace *t)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    size_t cap = 1024;
+    memset(t, 0, sizeof(*t));
+    t->frames = malloc(cap * sizeof(uint64_t));
+    t->hashes = malloc(cap * sizeof(uint64_t));
+    t->ns = malloc(cap * sizeof(uint64_t));
+    char line[128];
+    unsigned long long frame, hash, ns;
+    while (t->ns && fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%llu %llx %llu", &frame, &hash, &ns) != 3)
+            continue;
+        if (t->count == cap) {
+            cap *= 2;
+            t->frames = realloc(t->frames, cap * sizeof(uint64_t));
+            t->hashes = realloc(t->hashes, cap * sizeof(uint64_t));
+            t->ns = realloc(t->ns, cap * sizeof(uint64_t));
+            if (!t->frames || !t->hashes || !t->ns)
+                break;
+        }
+        t->frames[t->count] = frame;
+        t->hashes[t->count] = hash;
+        t->ns[t->count] = ns;
+        t->count++;
+    }
+    fclose(f);
+    if (!t->frames || !t->hashes || !t->ns) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int by_value(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+struct summary {
+    double mean, median, p99, max, total;
+};
+
+static struct summary summarise(const struct trace *t)
+{
+    struct summary s = {0};
+    if (t->count == 0)
+        return s;
+    uint64_t *sorted = malloc(t->count * sizeof(uint64_t));
+    if (!sorted)
+        return s;
+    memcpy(sorted, t->ns, t->count * sizeof(uint64_t));
+    qsort(sorted, t->count, sizeof(uint64_t), by_value);
+    for (size_t i = 0; i < t->count; i++)
+        s.total += sorted[i];
+    s.mean = s.total / t->count;
+    s.median = sorted[t->count / 2];
+    s.p99 = sorted[(t->count - 1) * 99 / 100];
+    s.max = sorted[t->count - 1];
+    free(sorted);
+    return s;
+}
+
+static void print_summary(const char *name, const struct trace *t, const struct summary *s)
+{
+    printf("%-10s %8zu frames %10.1f %10.1f %10.1f %10.1f us %9.3f s\n", name, t->count,
+           s->mean / 1e3, s->median / 1e3, s->p99 / 1e3, s->max / 1e3, s->total / 1e9);
+}
+
+int main(int argc, char **argv)
+{
+    double threshold = -1;
+    int arg = 1;
+    if (argc > 2 && strcmp(argv[1], "-t") == 0) {
+        threshold = atof(argv[2]);
+        arg = 3;
+    }
+    if (argc - arg != 2) {
+        fprintf(stderr, "usage: %s [-t percent] base.trace new.trace\n", argv[0]);
+        return 2;
+    }
+
+    struct trace base, cur;
+    if (read_trace(argv[arg], &base) != 0 || read_trace(argv[arg + 1], &cur) != 0)
+        return 2;
+
+    int failed = 0;
+    size_t n = base.count < cur.count ? base.count : cur.count;
+    size_t i;
+    for (i = 0; i < n; i++) {
+        if (base.frames[i] != cur.frames[i] || base.hashes[i] != cur.hashes[i])
+            break;
+    }
+    if (i < n) {
+        printf("frame %llu differs: %016llx, was %016llx\n", (unsigned long long)cur.frames[i],
+               (unsigned long long)cur.hashes[i], (unsigned long long)base.hashes[i]);
+        failed = 1;
+    } else if (base.count != cur.count) {
+        printf("first %zu frames match, then the traces have %zu and %zu frames\n", n, base.count,
+               cur.count);
+        failed = 1;
+    } else {
+        printf("all %zu frames match\n", n);
+    }
+
+    struct summary b = summarise(&base), c = summarise(&cur);
+    printf("%-10s %15s %10s %10s %10s %10s %11s\n", "", "", "mean", "median", "p99", "max", "total");
+    print_summary("base", &base, &b);
+    print_summary("new", &cur, &c);
+    if (b.median > 0) {
+        double change = (c.median / b.median - 1) * 100;
+        printf("median frame time %+.1f%%, total %+.1f%%\n", change, (c.total / b.total - 1) * 100);
+        if (threshold >= 0 && change > threshold) {
+            printf("median frame time regressed more than %.1f%%\n", threshold);
+            failed = 1;
+        }
+    }
+    return failed;
+}